@@ -25,17 +25,35 @@ file included with the axographio package:
 from .version import version as __version__
 from .version import git_revision as __git_revision__
 from .extension import *
+from .corpus import corpus_index, corpus_entry
 from . import tests
 from .tests.test_axographio import example_files
 
 # explicit listing needed to ensure pydoc/help() finds everything
 __all__ = [
     'file_contents',
+    'lazy_file_contents',
+    'file_header',
+    'column_info',
     'linearsequence',
     'scaledarray',
     'aslinearsequence',
     'asscaledarray',
     'read',
+    'read_header',
+    'read_trailer',
+    'file_trailer',
+    'trace_header',
+    'read_many',
+    'read_matrix',
+    'sweep_matrix',
+    'read_envelope',
+    'read_chunks',
+    'file_chunk',
+    'column_envelope',
+    'corpus_index',
+    'corpus_entry',
+    'stream_writer',
     'axograph_x_format',
     'newest_format',
     'old_digitized_format',
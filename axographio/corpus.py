@@ -0,0 +1,419 @@
+"""A persistent index of the Axograph files in directory trees
+
+Use `index = axographio.corpus_index(filename)` to open (or create) an index,
+`index.update(directory)` to crawl a directory tree into it, and
+`index.find(...)` to search it, e.g.
+
+>>> index = axographio.corpus_index('recordings.axgindex')
+>>> index.update('recordings')
+>>> long_recordings = index.find(column='Current (pA)', min_points=1000000)
+
+Each file is scanned once, reading only its column headers and trailer (see
+read_header and read_trailer), on a pool of native threads. The index records
+every file it has scanned by path, size and modification time, so crawling
+the same tree again only scans the files that are new or have changed, and
+forgets those that are gone. Queries are answered from the index alone,
+without opening any data file.
+
+The index is stored as an SQLite database, so it can also be queried
+directly: the files table has one row per file (with fileformat 0 for files
+that are not Axograph files), and the columns and traces tables one row per
+column and trace of each file.
+
+To update an index from the command line, run
+
+    axographio-index INDEX DIRECTORY [DIRECTORY ...]
+
+"""
+
+import os
+import sqlite3
+import stat
+import sys
+
+from .extension import _scan_many, column_info, file_trailer, trace_header
+
+
+# Files scanned, and committed to the index, at a time
+_batch_files = 1024
+
+# Increment whenever the tables change
+_schema_version = 1
+
+_schema = """
+CREATE TABLE IF NOT EXISTS files (
+    id INTEGER PRIMARY KEY,
+    path TEXT UNIQUE NOT NULL,
+    size INTEGER NOT NULL,
+    mtime INTEGER NOT NULL,
+    fileformat INTEGER NOT NULL,
+    comment TEXT NOT NULL,
+    notes TEXT NOT NULL);
+
+CREATE TABLE IF NOT EXISTS columns (
+    file INTEGER NOT NULL,
+    number INTEGER NOT NULL,
+    name TEXT NOT NULL,
+    type INTEGER NOT NULL,
+    points INTEGER NOT NULL,
+    data_offset INTEGER NOT NULL,
+    data_bytes INTEGER NOT NULL,
+    PRIMARY KEY (file, number)) WITHOUT ROWID;
+
+CREATE INDEX IF NOT EXISTS columns_by_name ON columns (name, points);
+
+CREATE TABLE IF NOT EXISTS traces (
+    file INTEGER NOT NULL,
+    number INTEGER NOT NULL,
+    x_column INTEGER NOT NULL,
+    y_column INTEGER NOT NULL,
+    error_column INTEGER NOT NULL,
+    negative_error_column INTEGER NOT NULL,
+    group_number INTEGER NOT NULL,
+    shown INTEGER NOT NULL,
+    x_min REAL NOT NULL,
+    x_max REAL NOT NULL,
+    x_min_positive REAL NOT NULL,
+    x_regular INTEGER NOT NULL,
+    x_monotonic INTEGER NOT NULL,
+    x_interval REAL NOT NULL,
+    y_min REAL NOT NULL,
+    y_max REAL NOT NULL,
+    y_min_positive REAL NOT NULL,
+    PRIMARY KEY (file, number)) WITHOUT ROWID;
+"""
+
+_string_types = (str, type(u''))
+
+
+
+def _filename(path):
+    """Encode a path as bytes, as the native code needs it"""
+    if isinstance(path, bytes):
+        return path
+    try:
+        return os.fsencode(path)
+    except AttributeError:
+        return path.encode(sys.getfilesystemencoding())
+
+
+
+def _mtime(info):
+    """The modification time from os.stat, in integer nanoseconds"""
+    try:
+        return info.st_mtime_ns
+    except AttributeError:
+        return int(info.st_mtime * 1e9)
+
+
+
+def _under(path, roots):
+    """Whether path is one of roots, or inside one of them"""
+    for root in roots:
+        if path == root or path.startswith(root.rstrip(os.sep) + os.sep):
+            return True
+    return False
+
+
+
+class corpus_entry:
+    """One Axograph file in a corpus_index
+
+    path is the absolute path of the file, and size and mtime are its size in
+        bytes and modification time (in nanoseconds since the epoch) when it
+        was scanned.
+
+    fileformat is the format of the file (see file_contents).
+
+    names is a list of column names, and columns a list of column_info
+        objects describing each column, as in file_header.
+
+    trailer is a file_trailer object holding the file's comment, notes, and
+        trace headers, with the range of each trace's values (see
+        read_trailer).
+
+    """
+    def __init__(self, path, size, mtime, fileformat, columns, trailer):
+        self.path = path
+        self.size = size
+        self.mtime = mtime
+        self.fileformat = fileformat
+        self.names = [c.name for c in columns]
+        self.columns = columns
+        self.trailer = trailer
+
+    def __repr__(self):
+        return 'corpus_entry(%r, %d columns)' % (self.path, len(self.columns))
+
+
+
+class corpus_index:
+    """A persistent index of the Axograph files in directory trees
+
+    filename is the index file, which is created if it does not exist.
+    An index is a sequence of corpus_entry objects, one for each Axograph
+    file in it, in order of path; an entry can also be looked up by path
+    with index[path], and `path in index` checks for one. Files are added
+    with update() and searched with find(). The index should be closed
+    with close(), or used as a context manager.
+
+    """
+    def __init__(self, filename):
+        self._db = sqlite3.connect(filename)
+        try:
+            version = self._db.execute('PRAGMA user_version').fetchone()[0]
+            if version not in (0, _schema_version):
+                raise IOError('%r is not a corpus index of this version'
+                        % filename)
+            self._db.executescript(_schema)
+            self._db.execute('PRAGMA user_version = %d' % _schema_version)
+            self._db.commit()
+        except sqlite3.DatabaseError:
+            self._db.close()
+            raise IOError('%r is not a corpus index' % filename)
+        except:
+            self._db.close()
+            raise
+
+    def close(self):
+        self._db.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+    def update(self, roots, extensions = None, workers = None):
+        """Crawl directory trees, scanning the files that are new or changed
+
+        roots is a directory, or a list of directories. Every regular file
+        within them is scanned unless the index already holds it with the
+        same size and modification time. If extensions is given (e.g.
+        ['.axgx', '.axgd']), only files whose names end with one of them
+        (ignoring case) are considered. Files the index holds within the
+        roots that are not found again, because they are gone or are not
+        considered, are removed from it. Files that are not Axograph files
+        are remembered too, so they are not scanned again until they change.
+        Axograph files that cannot be read (because they are damaged, or an
+        error occurs reading them) are left out, and scanned again by every
+        update until they can be.
+
+        The files are scanned on a pool of native threads, as in read_many;
+        workers is the number of threads to use (by default, one per
+        processor). Changes are committed after every batch of files, so an
+        interrupted crawl keeps most of its work.
+
+        Returns the number of files scanned and the number removed.
+
+        """
+        if isinstance(roots, _string_types):
+            roots = [roots]
+        roots = [os.path.abspath(root) for root in roots]
+        if extensions is not None:
+            extensions = tuple(extension.lower() for extension in extensions)
+
+        known = {}
+        for path, size, mtime in self._db.execute(
+                'SELECT path, size, mtime FROM files'):
+            if _under(path, roots):
+                known[path] = (size, mtime)
+
+        scanned = 0
+        pending = []
+        seen = set()
+        for root in roots:
+            for directory, subdirectories, names in os.walk(root):
+                subdirectories.sort()
+                for name in sorted(names):
+                    if (extensions is not None and
+                            not name.lower().endswith(extensions)):
+                        continue
+                    path = os.path.join(directory, name)
+                    try:
+                        info = os.stat(path)
+                    except OSError:
+                        continue
+                    if not stat.S_ISREG(info.st_mode) or path in seen:
+                        continue
+                    seen.add(path)
+                    key = (info.st_size, _mtime(info))
+                    if known.get(path) == key:
+                        continue
+                    pending += [(path,) + key]
+                    if len(pending) >= _batch_files:
+                        scanned += self._scan(pending, workers)
+                        pending = []
+        scanned += self._scan(pending, workers)
+
+        removed = [path for path in known if path not in seen]
+        with self._db:
+            for path in removed:
+                self._remove(path)
+        return scanned, len(removed)
+
+    def _scan(self, pending, workers):
+        """Scan a batch of files and replace their entries"""
+        results = _scan_many([_filename(path) for path, _, _ in pending],
+                workers)
+        scanned = 0
+        with self._db:
+            for (path, size, mtime), result in zip(pending, results):
+                self._remove(path)
+                if result is None:
+                    continue    # gone since the directory was listed
+                scanned += 1
+                if result is False:
+                    self._db.execute('INSERT INTO files (path, size, mtime, '
+                            'fileformat, comment, notes) '
+                            "VALUES (?, ?, ?, 0, '', '')",
+                            (path, size, mtime))
+                    continue
+                elif not isinstance(result, tuple):
+                    continue    # unreadable for now: scanned again next time
+
+                header, trailer = result
+                cursor = self._db.execute('INSERT INTO files (path, size, '
+                        'mtime, fileformat, comment, notes) '
+                        'VALUES (?, ?, ?, ?, ?, ?)', (path, size, mtime,
+                        header.fileformat, trailer.comment, trailer.notes))
+                file = cursor.lastrowid
+                self._db.executemany('INSERT INTO columns '
+                        'VALUES (?, ?, ?, ?, ?, ?, ?)',
+                        [(file, number, c.name, c.type, c.points, c.offset,
+                        c.nbytes) for number, c in enumerate(header.columns)])
+                self._db.executemany('INSERT INTO traces VALUES '
+                        '(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)',
+                        [(file, number, t.x_column, t.y_column,
+                        t.error_column, t.negative_error_column, t.group,
+                        t.shown, t.x_min, t.x_max, t.x_min_positive,
+                        t.x_regular, t.x_monotonic, t.x_interval, t.y_min,
+                        t.y_max, t.y_min_positive)
+                        for number, t in enumerate(trailer.traces)])
+        return scanned
+
+    def _remove(self, path):
+        """Remove a file's entry, if it has one"""
+        row = self._db.execute('SELECT id FROM files WHERE path = ?',
+                (path,)).fetchone()
+        if row is not None:
+            self._db.execute('DELETE FROM columns WHERE file = ?', row)
+            self._db.execute('DELETE FROM traces WHERE file = ?', row)
+            self._db.execute('DELETE FROM files WHERE id = ?', row)
+
+    def _entries(self, where = '', parameters = ()):
+        """The entries of the Axograph files matching an SQL condition"""
+        rows = self._db.execute('SELECT id, path, size, mtime, fileformat, '
+                'comment, notes FROM files WHERE fileformat != 0 ' + where +
+                ' ORDER BY path', parameters).fetchall()
+        entries = []
+        for file, path, size, mtime, fileformat, comment, notes in rows:
+            columns = [column_info(*row) for row in self._db.execute(
+                    'SELECT name, type, points, data_offset, data_bytes '
+                    'FROM columns WHERE file = ? ORDER BY number', (file,))]
+            traces = []
+            for row in self._db.execute('SELECT x_column, y_column, '
+                    'error_column, negative_error_column, group_number, '
+                    'shown, x_min, x_max, x_min_positive, x_regular, '
+                    'x_monotonic, x_interval, y_min, y_max, y_min_positive '
+                    'FROM traces WHERE file = ? ORDER BY number', (file,)):
+                row = list(row)
+                for flag in (5, 9, 10):     # shown, x_regular, x_monotonic
+                    row[flag] = bool(row[flag])
+                traces += [trace_header(*row)]
+            entries += [corpus_entry(path, size, mtime, fileformat, columns,
+                file_trailer(comment, notes, traces))]
+        return entries
+
+    def find(self, column = None, min_points = None, max_points = None,
+            type = None, fileformat = None, text = None):
+        """Find the Axograph files in the index that match all of the given
+        conditions, without opening any of them
+
+        column, min_points, max_points and type select files with at least
+        one column that has the given name, at least min_points and at most
+        max_points values, and the given AxoGraph column type number. For
+        example, `find(column='Current (pA)', min_points=1000000)` finds the
+        files with a 'Current (pA)' column of at least a million points.
+
+        fileformat selects files in the given format, and text those whose
+        comment or notes contain it.
+
+        Returns a list of corpus_entry objects, in order of path.
+
+        """
+        conditions = []
+        parameters = []
+        for value, condition in ((column, 'name = ?'),
+                (min_points, 'points >= ?'), (max_points, 'points <= ?'),
+                (type, 'type = ?')):
+            if value is not None:
+                conditions += [condition]
+                parameters += [value]
+        where = ''
+        if conditions:
+            where += (' AND EXISTS (SELECT 1 FROM columns '
+                    'WHERE columns.file = files.id AND ' +
+                    ' AND '.join(conditions) + ')')
+        if fileformat is not None:
+            where += ' AND fileformat = ?'
+            parameters += [fileformat]
+        if text is not None:
+            where += ' AND (instr(comment, ?) > 0 OR instr(notes, ?) > 0)'
+            parameters += [text, text]
+        return self._entries(where, parameters)
+
+    def __len__(self):
+        return self._db.execute('SELECT COUNT(*) FROM files '
+                'WHERE fileformat != 0').fetchone()[0]
+
+    def __iter__(self):
+        return iter(self._entries())
+
+    def __contains__(self, path):
+        return self._db.execute('SELECT 1 FROM files WHERE path = ? '
+                'AND fileformat != 0', (os.path.abspath(path),)).fetchone() \
+                is not None
+
+    def __getitem__(self, path):
+        entries = self._entries('AND path = ?', (os.path.abspath(path),))
+        if not entries:
+            raise KeyError(path)
+        return entries[0]
+
+
+
+def main(argv = None):
+    """Update a corpus index from the command line"""
+    import argparse
+
+    parser = argparse.ArgumentParser(prog = 'axographio-index',
+            description = 'Crawl directories of Axograph files into an '
+            'index, scanning only the files that are new or have changed.')
+    parser.add_argument('index', help = 'the index file')
+    parser.add_argument('directories', nargs = '*',
+            help = 'directories to crawl')
+    parser.add_argument('--extensions', nargs = '+', metavar = 'EXTENSION',
+            help = 'only consider files with these extensions')
+    parser.add_argument('--workers', type = int,
+            help = 'number of threads to scan files on')
+    parser.add_argument('--column', help = 'list the files with this column')
+    parser.add_argument('--min-points', type = int,
+            help = 'list the files with a column this long')
+    args = parser.parse_args(argv)
+
+    with corpus_index(args.index) as index:
+        if args.directories:
+            scanned, removed = index.update(args.directories,
+                    args.extensions, args.workers)
+            print('scanned %d files, removed %d; %d Axograph files indexed'
+                    % (scanned, removed, len(index)))
+        if args.column is not None or args.min_points is not None:
+            for entry in index.find(column = args.column,
+                    min_points = args.min_points):
+                print(entry.path)
+
+
+
+if __name__ == '__main__':
+    main()
@@ -1,27 +1,78 @@
 # cython: c_string_type=str, c_string_encoding=ascii
 
+import collections
+import threading
+
 import numpy as np
 cimport numpy as np
+from cpython.buffer cimport PyBuffer_FillInfo
+
+cdef extern from "limits.h":
+    long long LLONG_MAX
 
 cdef extern from "stdlib.h":
-    ctypedef int size_t
     void* malloc(size_t num)
     void free(void*)
     void* memcpy(void* destination, void* source, size_t num)
     void* memset(void* destination, int source, size_t num)
 
-cdef extern from "include/axograph_readwrite/fileUtils.h":
+cdef extern from "include/axograph_readwrite/fileUtils.h" nogil:
     ctypedef void* AGDataRef
+    ctypedef long long int64_t
     ctypedef extern char* const_char_ptr "const char*"
+    ctypedef extern void* const_void_ptr "const void*"
     AGDataRef NewFile( const_char_ptr fileName )
     AGDataRef OpenFile( const_char_ptr fileName )
+    AGDataRef OpenMappedFile( const_char_ptr fileName )
+    AGDataRef OpenPositionedFile( const_char_ptr fileName )
     void CloseFile( AGDataRef dataRefNum )
-
-
-cdef extern from "include/axograph_readwrite/AxoGraph_ReadWrite.h":
+    int SetFilePosition( AGDataRef dataRefNum, int64_t posn )
+    int GetFilePosition( AGDataRef dataRefNum, int64_t *posn )
+    int MapFromFile( AGDataRef dataRefNum, int64_t *count,
+            const_void_ptr *dataPointer )
+
+
+cdef extern from "include/axograph_readwrite/sampleUtils.h" nogil:
+    cdef cppclass SampleExtremes[T]:
+        T low
+        T high
+        T lowestAboveZero
+        T highestBelowZero
+
+    void FindSampleExtremes( float *samples, int64_t count,
+            SampleExtremes[float] *extremes )
+    void FindSampleExtremes( double *samples, int64_t count,
+            SampleExtremes[double] *extremes )
+
+    void QuantizeFloatArray( float *samples, int64_t count, double scale,
+            double offset, short *quantized, double *maximumError )
+    void QuantizeDoubleArray( double *samples, int64_t count, double scale,
+            double offset, short *quantized, double *maximumError )
+
+    bint FindFloatSequence( float *samples, int64_t count, double tolerance,
+            double *firstValue, double *increment )
+    bint FindDoubleSequence( double *samples, int64_t count,
+            double tolerance, double *firstValue, double *increment )
+
+    struct ShortStatistics:
+        int64_t count
+        int64_t sum
+        int64_t sumOfSquares
+        short minimum
+        short maximum
+        int64_t minimumIndex
+        int64_t maximumIndex
+
+    void FindShortStatistics( short *samples, int64_t count, bint swapped,
+            ShortStatistics *statistics )
+
+cdef extern from "include/axograph_readwrite/byteswap.h" nogil:
+    void ByteSwapShort( short *shortNumber )
+
+cdef extern from "include/axograph_readwrite/AxoGraph_ReadWrite.h" nogil:
     ctypedef int int32_t
     enum ag_errors:
-        kAG_MemoryErr, kAG_FormatErr, kAG_VersionErr
+        kAG_MemoryErr, kAG_FormatErr, kAG_VersionErr, kAG_ShapeErr
 
     enum ColumnType:
         IntType,
@@ -61,6 +112,27 @@ cdef extern from "include/axograph_readwrite/AxoGraph_ReadWrite.h":
         SeriesArray seriesArray
         ScaledShortArray scaledShortArray
 
+    struct ColumnRange:
+        double minimum
+        double maximum
+        double minimumPositive
+        bint monotonic
+        bint regularlySpaced
+        double interval
+
+    struct ColumnIndexEntry:
+        int64_t headerPosition
+        int64_t dataPosition
+        int64_t dataBytes
+        ColumnData column
+
+    struct ColumnIndex:
+        int fileFormat
+        int fileVersion
+        int32_t numberOfColumns
+        int64_t trailerPosition
+        ColumnIndexEntry *columns
+
     int kAxoGraph_Graph_Format
     int kAxoGraph_Digitized_Format
     int kAxoGraph_X_Format
@@ -70,9 +142,45 @@ cdef extern from "include/axograph_readwrite/AxoGraph_ReadWrite.h":
     int AG_GetNumberOfColumns( AGDataRef refNum, int fileFormat,
             int32_t *numberOfColumns )
 
+    int AG_BuildColumnIndex( AGDataRef refNum, ColumnIndex *columnIndex )
+
+    void AG_FreeColumnIndex( ColumnIndex *columnIndex )
+
+    int AG_SeekColumn( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber )
+
     int AG_ReadColumn( AGDataRef refNum, int fileFormat,
             int columnNumber, ColumnData *columnData )
 
+    int AG_ReadColumnRange( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber, int32_t start, int32_t stop,
+            ColumnData *columnData )
+
+    int AG_MapColumn( AGDataRef refNum, int fileFormat,
+            int columnNumber, ColumnData *columnData )
+
+    int AG_ReadColumnRangeInto( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber, int32_t start, int32_t stop, void *columnArray )
+
+    int AG_ReadColumnAsFloat( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber, int32_t start, int32_t stop, float *floatArray )
+
+    int AG_ReadColumnAsDouble( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber, int32_t start, int32_t stop,
+            double *doubleArray )
+
+    int AG_GetMatrixShape( ColumnIndex *columnIndex, int32_t *numberOfSweeps,
+            int32_t *points )
+
+    int AG_ReadMatrixAsFloat( AGDataRef refNum, ColumnIndex *columnIndex,
+            float *matrix )
+
+    int AG_ReadMatrixAsDouble( AGDataRef refNum, ColumnIndex *columnIndex,
+            double *matrix )
+
+    int AG_ReadColumnEnvelope( AGDataRef refNum, ColumnIndex *columnIndex,
+            int columnNumber, int32_t bins, double *minima, double *maxima )
+
     int AG_ReadFloatColumn( AGDataRef refNum, int fileFormat,
             int columnNumber, ColumnData *columnData )
 
@@ -81,6 +189,131 @@ cdef extern from "include/axograph_readwrite/AxoGraph_ReadWrite.h":
     int AG_WriteColumn( AGDataRef refNum, int fileFormat,
             int columnNumber, ColumnData *columnData )
 
+    int AG_WriteColumnWithRange( AGDataRef refNum, int fileFormat,
+            int columnNumber, ColumnData *columnData,
+            ColumnRange *columnRange )
+
+
+cdef extern from "include/axograph_readwrite/AxoGraph_ReadMany.h" nogil:
+    int kAG_ColumnErr
+    int kAG_FileNotFoundErr
+
+    struct AGColumnSelection:
+        int32_t numberOfColumnNumbers
+        int32_t *columnNumbers
+        int32_t numberOfNames
+        char **names
+
+    struct AGBatchFile:
+        const_char_ptr fileName
+        int result
+        int fileFormat
+        int32_t numberOfColumns
+        ColumnData *columns
+
+    void AG_ReadFiles( AGBatchFile *files, int32_t numberOfFiles,
+            AGColumnSelection *selection, int threads, bint useRing )
+
+    void AG_FreeBatchFile( AGBatchFile *file )
+
+    struct AGColumnRead:
+        int32_t columnNumber
+        int32_t start
+        int32_t stop
+        void *array
+
+    int AG_ReadColumnsParallel( AGDataRef refNum, ColumnIndex *columnIndex,
+            AGColumnRead *reads, int32_t numberOfReads, int arrayType,
+            int threads )
+
+
+cdef extern from "include/axograph_readwrite/AxoGraph_Trailer.h" nogil:
+    struct AGTraceHeader:
+        int32_t xColumn
+        int32_t yColumn
+        int32_t errorBarColumn
+        int32_t negativeErrorBarColumn
+        int32_t group
+        bint shown
+        double minX
+        double maxX
+        double minPositiveX
+        bint xRegularlySpaced
+        bint xMonotonic
+        double xInterval
+        double minY
+        double maxY
+        double minPositiveY
+
+    struct AGTrailer:
+        unsigned char *comment
+        unsigned char *notes
+        int32_t numberOfTraces
+        AGTraceHeader *traces
+
+    int AG_ReadTrailer( AGDataRef refNum, ColumnIndex *columnIndex,
+            AGTrailer *trailer )
+
+    void AG_FreeTrailer( AGTrailer *trailer )
+
+    void AG_InitTraceHeader( AGTraceHeader *trace, int32_t xColumn,
+            int32_t yColumn, ColumnRange *xRange, ColumnRange *yRange )
+
+    int AG_WriteTrailer( AGDataRef refNum, AGTrailer *trailer )
+
+
+cdef extern from "include/axograph_readwrite/AxoGraph_ReadMany.h" nogil:
+    # declared after AGTrailer, which it holds
+    struct AGScannedFile:
+        const_char_ptr fileName
+        int result
+        ColumnIndex columnIndex
+        AGTrailer trailer
+
+    void AG_ScanFiles( AGScannedFile *files, int32_t numberOfFiles,
+            int threads )
+
+    void AG_FreeScannedFile( AGScannedFile *file )
+
+
+cdef extern from "include/axograph_readwrite/AxoGraph_Stream.h" nogil:
+    struct AGStreamChannel:
+        const_char_ptr title
+        int type
+
+    struct AGStream:
+        pass
+
+    AGStream *AG_OpenStream( const_char_ptr fileName, int32_t numberOfChannels,
+            AGStreamChannel *channels, int32_t bufferPoints, int *result )
+
+    int AG_AppendToStream( AGStream *stream, int32_t channel,
+            const_void_ptr samples, int32_t count )
+
+    int AG_FlushStream( AGStream *stream )
+
+    int AG_CloseStream( AGStream *stream )
+
+    int32_t AG_StreamColumns( AGStream *stream )
+
+
+cdef extern from "include/axograph_readwrite/AxoGraph_Chunks.h" nogil:
+    ctypedef extern ColumnData* const_columndata_ptr "const ColumnData*"
+
+    struct AGChunkReader:
+        pass
+
+    AGChunkReader *AG_OpenChunkReader( AGDataRef refNum,
+            ColumnIndex *columnIndex, int32_t numberOfColumns,
+            int32_t *columnNumbers, int32_t chunkPoints, int arrayType,
+            int *result )
+
+    int AG_ReadChunk( AGChunkReader *reader, int32_t *start )
+
+    const_columndata_ptr AG_ChunkColumn( AGChunkReader *reader,
+            int32_t column )
+
+    void AG_CloseChunkReader( AGChunkReader *reader )
 
 
 # supported file formats
@@ -109,37 +342,418 @@ class file_contents:
         self.data = data
         self.fileformat = fileformat
 
-    def write(self, filename):
-        """Write this file to the given filename"""
+    def write(self, char* filename, trailer=False, comment='', notes='',
+            series_tolerance=1e-6):
+        """Write this file to the given filename
+
+        The global interpreter lock is released while each column is
+        written, so several files can be written at once from Python
+        threads. The data must not be modified by another thread meanwhile.
+
+        If trailer is true, which is only possible for axograph_x_format,
+        the file ends with the given comment and notes and a trace for each
+        column after the first, plotted against the first. The range of
+        each column is found as it is written, and stored in the trace
+        headers, so that AxoGraph does not have to scan the data to set up
+        the axes when the file is opened.
+
+        In axograph_x_format files, a floating point first (time) column
+        whose values are regularly spaced, to within series_tolerance times
+        their interval, is stored as a series of just its first value and
+        interval, as a linearsequence would be. Pass None to store it as
+        given.
+
+        """
         cdef int result
+        cdef int32_t numcolumns = len(self.data)
+        cdef int fileformat = self.fileformat
+        cdef int i
         cdef ColumnData columndata
+        cdef ColumnRange* ranges = NULL
+        cdef ColumnRange* columnrange = NULL
+        cdef AGTrailer contents
+        cdef AGDataRef file
+
+        if trailer and fileformat != kAxoGraph_X_Format:
+            raise ValueError('only axograph_x_format files have a trailer')
+        commentbytes = comment.encode('latin-1')
+        notesbytes = notes.encode('latin-1')
+        memset(&contents, 0, sizeof(AGTrailer))
 
         # open the file
-        cdef AGDataRef file = NewFile(filename)
+        with nogil:
+            file = NewFile(filename)
         if file == NULL:
             raise IOError('file not found')
 
         try:
+            if trailer:
+                ranges = <ColumnRange*>malloc(
+                        (numcolumns + 1) * sizeof(ColumnRange))
+                contents.traces = <AGTraceHeader*>malloc(
+                        (numcolumns + 1) * sizeof(AGTraceHeader))
+                if ranges == NULL or contents.traces == NULL:
+                    raise MemoryError()
 
             # write file the header
-            result = AG_WriteHeader( file, self.fileformat, len(self.data) )
+            with nogil:
+                result = AG_WriteHeader(file, fileformat, numcolumns)
             if result != 0:
                 raise IOError((result,
                     'AG_WriteHeader returned error %d' % result))
 
-            # write each column
-            for i in range(len(self.data)):
-                prepare_columndata(&columndata, i, self.fileformat,
-                        self.names[i], self.data[i])
-
-                result = AG_WriteColumn(file, self.fileformat, i, &columndata)
+            # write each column straight from its array, which is not
+            # modified (so it may be read-only), finding its range on the
+            # way if there is to be a trailer
+            for i in range(numcolumns):
+                columndata.title = NULL
+                if ranges != NULL:
+                    columnrange = &ranges[i]
+                try:
+                    array = prepare_columndata(&columndata, i, fileformat,
+                            self.names[i], self.data[i], series_tolerance)
+
+                    with nogil:
+                        result = AG_WriteColumnWithRange(file, fileformat, i,
+                                &columndata, columnrange)
+                finally:
+                    free_columntitle(&columndata)
                 if result != 0:
                     raise IOError((result,
                         'AG_WriteColumn returned error %d' % result))
-                free_columndata(&columndata)
+
+            if trailer:
+                contents.comment = <unsigned char*><char*>commentbytes
+                contents.notes = <unsigned char*><char*>notesbytes
+                contents.numberOfTraces = max(numcolumns - 1, 0)
+                with nogil:
+                    for i in range(contents.numberOfTraces):
+                        AG_InitTraceHeader(&contents.traces[i], 0, i + 1,
+                                &ranges[0], &ranges[i + 1])
+                    result = AG_WriteTrailer(file, &contents)
+                if result != 0:
+                    raise IOError((result,
+                        'AG_WriteTrailer returned error %d' % result))
 
         finally:
-            CloseFile(file)
+            free(ranges)
+            free(contents.traces)
+            with nogil:
+                CloseFile(file)
+
+
+
+_stream_types = {
+    np.dtype(np.int16): ShortArrayType,
+    np.dtype(np.int32): IntArrayType,
+    np.dtype(np.float32): FloatArrayType,
+    np.dtype(np.float64): DoubleArrayType,
+    }
+
+cdef class stream_writer:
+    """An Axograph X file written a chunk of samples at a time
+
+    names is a list of channel names, and dtypes an optional list of the
+    NumPy type each channel is stored as (int16, int32, float32 or float64;
+    float64 by default).
+
+    Samples passed to append are buffered, up to buffer_points samples per
+    channel, and a channel's samples are written out whenever its buffer
+    fills, and on flush and close. They extend the last column of the file
+    if it holds the same channel, and start a new column, named after the
+    channel, otherwise. While the writer is open a channel may therefore be
+    stored as several columns, but the file can be read, up to the last
+    flush, at any time (even if the writing process dies). On close the
+    file is left with exactly one column per channel, in channel order
+    (empty for a channel that was never given any samples), rewriting it
+    if need be. Memory use stays bounded however long the recording.
+
+    >>> import tempfile, os
+    >>> handle, filename = tempfile.mkstemp()
+    >>> with stream_writer(filename, ['Current (pA)'], [np.float32]) as w:
+    ...     w.append(0, [1.5, 2.5])
+    ...     w.append(0, [3.5])
+    >>> read(filename).data[0]
+    array([ 1.5,  2.5,  3.5], dtype=float32)
+    >>> os.close(handle); os.remove(filename)
+
+    """
+    cdef AGStream* stream
+    cdef readonly object names
+    cdef readonly object dtypes
+
+    def __cinit__(self):
+        self.stream = NULL
+
+    def __init__(self, char* filename, names, dtypes=None,
+            int buffer_points=65536):
+        cdef int result = 0
+        cdef int32_t numchannels = len(names)
+        cdef int i
+        cdef AGStreamChannel* channels
+        cdef char* name
+
+        if dtypes is None:
+            dtypes = [np.float64] * numchannels
+        if len(dtypes) != numchannels:
+            raise ValueError('one dtype is needed for each channel')
+        self.names = list(names)
+        self.dtypes = [np.dtype(dtype) for dtype in dtypes]
+        for dtype in self.dtypes:
+            if dtype not in _stream_types:
+                raise TypeError("Unsupported column data type %s"
+                        % repr(dtype))
+
+        channels = <AGStreamChannel*>malloc(
+                (numchannels + 1) * sizeof(AGStreamChannel))
+        if channels == NULL:
+            raise MemoryError()
+        try:
+            for i in range(numchannels):
+                name = self.names[i]
+                channels[i].title = name
+                channels[i].type = _stream_types[self.dtypes[i]]
+            with nogil:
+                self.stream = AG_OpenStream(filename, numchannels, channels,
+                        buffer_points, &result)
+        finally:
+            free(channels)
+        if self.stream == NULL:
+            raise IOError((result, 'AG_OpenStream returned error %d' % result))
+
+    def __dealloc__(self):
+        if self.stream != NULL:
+            AG_CloseStream(self.stream)
+
+    cdef _check_open(self):
+        if self.stream == NULL:
+            raise ValueError('stream is closed')
+
+    def append(self, int channel, data):
+        """Append a sequence of samples to the given channel"""
+        cdef int result
+        cdef np.ndarray array
+        cdef char* samples
+        cdef int32_t count
+
+        self._check_open()
+        if channel < 0 or channel >= len(self.dtypes):
+            raise IndexError('channel out of range')
+        array = np.ascontiguousarray(data, dtype=self.dtypes[channel])
+        samples = array.data
+        count = len(array)
+        with nogil:
+            result = AG_AppendToStream(self.stream, channel, samples, count)
+        if result != 0:
+            raise IOError((result,
+                'AG_AppendToStream returned error %d' % result))
+
+    def flush(self):
+        """Write out the samples buffered for every channel"""
+        cdef int result
+
+        self._check_open()
+        with nogil:
+            result = AG_FlushStream(self.stream)
+        if result != 0:
+            raise IOError((result,
+                'AG_FlushStream returned error %d' % result))
+
+    def close(self):
+        """Flush the buffered samples and close the file"""
+        cdef int result
+
+        if self.stream == NULL:
+            return
+        with nogil:
+            result = AG_CloseStream(self.stream)
+        self.stream = NULL
+        if result != 0:
+            raise IOError((result,
+                'AG_CloseStream returned error %d' % result))
+
+    property columns:
+        """The number of columns in the file so far (until the writer is
+        closed, a channel may be stored as several columns)"""
+        def __get__(self):
+            self._check_open()
+            return AG_StreamColumns(self.stream)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+
+class column_info:
+    """The description of one column in an axograph data file
+
+    name is the column name.
+
+    type is the AxoGraph column type number (e.g., 4 for int16 arrays, 9 for
+        linear sequences, or 10 for scaled int16 arrays).
+
+    points is the number of values in the column.
+
+    offset and nbytes give the position and size in bytes of the column's
+        sample data within the file (nbytes is 0 for linear sequences, which
+        are stored without samples).
+
+    """
+    def __init__(self, name, type, points, offset, nbytes):
+        self.name = name
+        self.type = type
+        self.points = points
+        self.offset = offset
+        self.nbytes = nbytes
+
+    def __repr__(self):
+        return 'column_info(%r, %d, %d, %d, %d)' % (self.name, self.type,
+                self.points, self.offset, self.nbytes)
+
+
+
+class file_header:
+    """The column directory of an axograph data file
+
+    names is a list of column names.
+
+    columns is a list of column_info objects describing each column.
+
+    fileformat is the format of the file (see file_contents).
+
+    """
+    def __init__(self, names, columns, fileformat):
+        self.names = names
+        self.columns = columns
+        self.fileformat = fileformat
+
+
+
+class sweep_matrix:
+    """The sweeps of an episodic axograph data file, as one 2D array
+
+    names is a list of column names; the first is the time column's.
+
+    time is the contents of the time column, shared by every sweep.
+
+    data is a C-contiguous array with one row for each sweep, in the order
+        of the columns after the time column.
+
+    fileformat is the format of the file (see file_contents).
+
+    """
+    def __init__(self, names, time, data, fileformat):
+        self.names = names
+        self.time = time
+        self.data = data
+        self.fileformat = fileformat
+
+
+
+class column_envelope:
+    """The lowest and highest value of a column in each of a number of bins,
+    for plotting the column at one bin per pixel
+
+    name is the column's name.
+
+    time holds the value of the time column (the first column of the file)
+    at the first sample of each bin, or NaN if the time column is too short
+    to have one.
+
+    minima and maxima hold the lowest and highest value in each bin, as
+    np.float64 arrays, with scaled int16 columns scaled.
+
+    points is the number of samples in the column; bin b holds samples
+    b * points // bins <= i < (b + 1) * points // bins.
+
+    """
+    def __init__(self, name, time, minima, maxima, points):
+        self.name = name
+        self.time = time
+        self.minima = minima
+        self.maxima = maxima
+        self.points = points
+
+
+
+class file_chunk(file_contents):
+    """One chunk of the columns of an axograph data file, as yielded by
+    read_chunks
+
+    names and data are as in file_contents, but data holds only samples
+    start <= i < start + chunk_points of each column (fewer, or none, for
+    columns that end within or before the chunk).
+
+    """
+    def __init__(self, names, data, fileformat, start):
+        file_contents.__init__(self, names, data, fileformat)
+        self.start = start
+
+
+
+class trace_header:
+    """The description of one trace (a pair of X and Y columns) stored after
+    the columns of an Axograph X file
+
+    x_column and y_column are the column numbers of the trace's data, and
+        error_column and negative_error_column those of its error bars
+        (or -1 if it has none).
+
+    group is the number of the group the trace belongs to, and shown is
+        False if the trace is hidden.
+
+    x_min, x_max, and x_min_positive are the smallest, largest, and smallest
+        positive X values in the trace (AxoGraph recalculates them if x_min
+        and x_max are both 0); y_min, y_max, and y_min_positive are the same
+        for the Y values.
+
+    x_regular is True if the X values are regularly spaced, x_interval apart,
+        and x_monotonic is True if each is larger than the one before.
+
+    """
+    def __init__(self, x_column, y_column, error_column = -1,
+            negative_error_column = -1, group = 0, shown = True,
+            x_min = 0., x_max = 0., x_min_positive = 0., x_regular = False,
+            x_monotonic = False, x_interval = 0., y_min = 0., y_max = 0.,
+            y_min_positive = 0.):
+        self.x_column = x_column
+        self.y_column = y_column
+        self.error_column = error_column
+        self.negative_error_column = negative_error_column
+        self.group = group
+        self.shown = shown
+        self.x_min = x_min
+        self.x_max = x_max
+        self.x_min_positive = x_min_positive
+        self.x_regular = x_regular
+        self.x_monotonic = x_monotonic
+        self.x_interval = x_interval
+        self.y_min = y_min
+        self.y_max = y_max
+        self.y_min_positive = y_min_positive
+
+    def __repr__(self):
+        return 'trace_header(%d, %d, y_min=%r, y_max=%r)' % (self.x_column,
+                self.y_column, self.y_min, self.y_max)
+
+
+
+class file_trailer:
+    """The comment, notes, and traces stored after the columns of an
+    Axograph X file
+
+    comment and notes are strings (empty if the file has none).
+
+    traces is a list of trace_header objects.
+
+    """
+    def __init__(self, comment, notes, traces):
+        self.comment = comment
+        self.notes = notes
+        self.traces = traces
 
 
 
@@ -192,6 +806,100 @@ class _getitem_iterator:
 
 
 
+cdef class _linearsequence_iterator:
+    """An iterator over the terms of a linearsequence, computed in C
+
+    >>> list(_linearsequence_iterator(linearsequence(3, 1.5, 0.25)))
+    [1.5, 1.75, 2.0]
+
+    """
+    cdef double start
+    cdef double step
+    cdef Py_ssize_t index
+    cdef Py_ssize_t numpoints
+
+    def __init__(self, sequence):
+        self.start = sequence.start
+        self.step = sequence.step
+        self.index = 0
+        self.numpoints = sequence.numpoints
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        if self.index >= self.numpoints:
+            raise StopIteration()
+        self.index += 1
+        return (self.index - 1) * self.step + self.start
+
+
+
+cdef class _scaledarray_iterator:
+    """An iterator over the values of a scaledarray
+
+    Each value is computed in C from the int16 sample it is read from, in
+    place and in either byte order, so the samples are never converted to
+    an array of doubles.
+
+    >>> list(_scaledarray_iterator(scaledarray([2, 7], 0.5, 0.25)))
+    [1.25, 3.75]
+
+    """
+    cdef np.ndarray data
+    cdef double scale
+    cdef double offset
+    cdef Py_ssize_t index
+    cdef bint swapped
+
+    def __init__(self, array):
+        self.data = np.asarray(array.data).ravel()
+        self.scale = array.scale
+        self.offset = array.offset
+        self.index = 0
+        self.swapped = not self.data.dtype.isnative
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        cdef short value
+        if self.index >= self.data.shape[0]:
+            raise StopIteration()
+        memcpy(&value, self.data.data + self.index * self.data.strides[0],
+                sizeof(short))
+        if self.swapped:
+            ByteSwapShort(&value)
+        self.index += 1
+        return value * self.scale + self.offset
+
+
+
+cdef ShortStatistics short_statistics(data, start, stop) except *:
+    """Find the statistics of samples start <= i < stop of an int16 array
+
+    The samples are read in place, in either byte order, unless they are
+    not contiguous, when only the window is copied (still as int16).
+
+    """
+    cdef ShortStatistics statistics
+    cdef np.ndarray samples
+    cdef int64_t count
+    cdef bint swapped
+
+    start, stop = _range_bounds(slice(start, stop), len(data))
+    samples = np.ascontiguousarray(np.asarray(data)[start:stop])
+    count = samples.size
+    swapped = not samples.dtype.isnative
+    with nogil:
+        FindShortStatistics(<short*>samples.data, count, swapped,
+                &statistics)
+    statistics.minimumIndex += start
+    statistics.maximumIndex += start
+    return statistics
+
+
+
 class linearsequence:
     """A sequence of terms of the form  a_k = m * k + b,   0 <= k < n
 
@@ -288,17 +996,105 @@ class linearsequence:
 
     def __iter__(self):
         """Implements iter(s)"""
-        return _getitem_iterator(self)
+        return _linearsequence_iterator(self)
+
+    # The summary statistics below are computed from closed forms, without
+    # generating the terms. Each applies to the terms start <= k < stop
+    # (all of them by default), and the arg functions return indices into
+    # the whole sequence.
+
+    def _window(self, start, stop):
+        """The first index, the number of terms, and the first term of a
+        window of the sequence"""
+        first, end = _range_bounds(slice(start, stop), self.numpoints)
+        return first, end - first, first * self.step + self.start
+
+    def sum(self, start=None, stop=None):
+        """The sum of the terms
 
+        >>> linearsequence(5, 1.125, 0.25).sum()
+        8.125
+
+        """
+        first, n, value = self._window(start, stop)
+        return n * value + self.step * n * (n - 1) / 2.
+
+    def mean(self, start=None, stop=None):
+        """The mean of the terms (NaN if there are none)"""
+        first, n, value = self._window(start, stop)
+        return value + self.step * (n - 1) / 2. if n > 0 else np.nan
+
+    def std(self, ddof=0, start=None, stop=None):
+        """The standard deviation of the terms, with n - ddof as the divisor
+
+        >>> linearsequence(4, 0., 2.).std()
+        2.23606797749979
+
+        """
+        first, n, value = self._window(start, stop)
+        if n - ddof <= 0:
+            return np.nan
+        return abs(self.step) * (n * (n * n - 1) / 12. / (n - ddof)) ** 0.5
+
+    def argmin(self, start=None, stop=None):
+        """The index of the (first) smallest term"""
+        first, n, value = self._window(start, stop)
+        if n == 0:
+            raise ValueError('no terms in the window')
+        return first + n - 1 if self.step < 0 else first
+
+    def argmax(self, start=None, stop=None):
+        """The index of the (first) largest term"""
+        first, n, value = self._window(start, stop)
+        if n == 0:
+            raise ValueError('no terms in the window')
+        return first + n - 1 if self.step > 0 else first
+
+    def min(self, start=None, stop=None):
+        """The smallest term"""
+        return self[self.argmin(start, stop)]
+
+    def max(self, start=None, stop=None):
+        """The largest term"""
+        return self[self.argmax(start, stop)]
+
+
+
+cdef find_linearsequence(np.ndarray samples, double tolerance):
+    """Get a float32 or float64 array as a linear sequence, or None
+
+    The samples are checked in a single pass in native code, which stops at
+    the first block of samples off the line.
+
+    """
+    cdef int64_t count
+    cdef double start = 0., step = 0.
+    cdef bint found
+
+    samples = np.ascontiguousarray(samples,
+            dtype=samples.dtype.newbyteorder('='))
+    count = samples.size
+    if samples.dtype == np.float32:
+        with nogil:
+            found = FindFloatSequence(<float*>samples.data, count, tolerance,
+                    &start, &step)
+    else:
+        with nogil:
+            found = FindDoubleSequence(<double*>samples.data, count,
+                    tolerance, &start, &step)
+    return linearsequence(count, start, step) if found else None
 
 
-def aslinearsequence(x):
+
+def aslinearsequence(x, tolerance = 1e-6):
     """ Convert an object to a linear sequence
 
     If x is a linear sequence, this function will just return x.
     Otherwise, it will try converting x to an array and checking if the
-    points form a linear sequence; if so it will return the sequence,
-    otherwise it will raise a TypeError.
+    points form a linear sequence, that is whether each lies within
+    tolerance times the step of the line from the first point to the
+    last; if so it will return the sequence, otherwise it will raise a
+    TypeError.
 
     >>> x = [1.2, 2.3, 3.4, 4.5]
     >>> y = aslinearsequence(x)
@@ -319,20 +1115,14 @@ def aslinearsequence(x):
         return x
     else:
         x = np.asarray(x)
+        if x.dtype != np.float32:
+            x = np.asarray(x, dtype=np.float64)
 
-        if len(x) == 0:
-            return linearsequence(0, 0., 0.)
-        elif len(x) == 1:
-            return linearsequence(1, x[0], 0)
-        else:
-            step = (x[-1] - x[0]) / (len(x) - 1)
-
-            diffs = (x[1:] - x[:-1]) / step - 1
-            if (np.max(np.abs(diffs)) > 1e-6):
-                raise TypeError(
-                        'Data could not be converted to a linear sequence')
-
-            return linearsequence(len(x), x[0], step)
+        sequence = find_linearsequence(x, tolerance)
+        if sequence is None:
+            raise TypeError(
+                    'Data could not be converted to a linear sequence')
+        return sequence
 
 
 
@@ -366,7 +1156,12 @@ class scaledarray:
         corresponding element in data times a scaling factor plus an offset.
 
         """
-        self.data = np.asarray(data, dtype=np.int16)
+        data = np.asarray(data)
+        # int16 data in either byte order (e.g., big-endian samples mapped
+        # straight from a file) is kept as is rather than copied
+        if data.dtype.kind != 'i' or data.dtype.itemsize != 2:
+            data = np.asarray(data, dtype=np.int16)
+        self.data = data
         self.scale = scale
         self.offset = offset
 
@@ -384,17 +1179,97 @@ class scaledarray:
 
     def __iter__(self):
         """Implements iter(s)"""
-        return _getitem_iterator(self)
+        return _scaledarray_iterator(self)
 
+    # The summary statistics below are computed in a single native pass over
+    # the int16 samples, in place, with the scale and offset applied to the
+    # results. The sums are exact. Each applies to the values start <= i <
+    # stop (all of them by default), and the arg functions return indices
+    # into the whole array.
 
+    def sum(self, start=None, stop=None):
+        """The sum of the values
 
-def asscaledarray(x, forceoffset = None):
+        >>> scaledarray([2, 7, 1, 8], 0.5, 0.25).sum()
+        10.0
+
+        """
+        cdef ShortStatistics statistics = short_statistics(self.data,
+                start, stop)
+        return self.scale * statistics.sum + self.offset * statistics.count
+
+    def mean(self, start=None, stop=None):
+        """The mean of the values (NaN if there are none)"""
+        cdef ShortStatistics statistics = short_statistics(self.data,
+                start, stop)
+        if statistics.count == 0:
+            return np.nan
+        return (self.scale * statistics.sum / float(statistics.count)
+                + self.offset)
+
+    def std(self, ddof=0, start=None, stop=None):
+        """The standard deviation of the values, with n - ddof as the divisor
+
+        >>> scaledarray([2, 4, 4, 4, 5, 5, 7, 9], 0.5, 0.25).std()
+        1.0
+
+        """
+        cdef ShortStatistics statistics = short_statistics(self.data,
+                start, stop)
+        n = statistics.count
+        total = statistics.sum
+        if n - ddof <= 0:
+            return np.nan
+        # n times the sum of the squared deviations of the samples, exactly
+        # (in Python integers, which cannot overflow)
+        deviations = n * statistics.sumOfSquares - total * total
+        return abs(self.scale) * (deviations / float(n * (n - ddof))) ** 0.5
+
+    def argmin(self, start=None, stop=None):
+        """The index of the (first) smallest value"""
+        cdef ShortStatistics statistics = short_statistics(self.data,
+                start, stop)
+        if statistics.count == 0:
+            raise ValueError('no values in the window')
+        if self.scale < 0:
+            return statistics.maximumIndex
+        return statistics.minimumIndex
+
+    def argmax(self, start=None, stop=None):
+        """The index of the (first) largest value"""
+        cdef ShortStatistics statistics = short_statistics(self.data,
+                start, stop)
+        if statistics.count == 0:
+            raise ValueError('no values in the window')
+        if self.scale < 0:
+            return statistics.minimumIndex
+        return statistics.maximumIndex
+
+    def min(self, start=None, stop=None):
+        """The smallest value"""
+        return self[self.argmin(start, stop)]
+
+    def max(self, start=None, stop=None):
+        """The largest value"""
+        return self[self.argmax(start, stop)]
+
+
+
+def asscaledarray(x, forceoffset = None, return_error = False):
     """ Convert an object to a scaled array
 
     If x is a scaled array, this function will just return x.
     Otherwise, it will try converting x to an array of doubles and
     distributing the values over the given range.  If forceoffset is
-    given it will be used as the offset; otherwise the mean will be used.
+    given it will be used as the offset; otherwise the middle of the range
+    will be used.
+
+    Each value is rounded to the nearest of the 16 bit levels, in two passes
+    over x that make no temporary copies of it: one finds the range of the
+    values, and the next quantizes them. Values outside the range that the
+    levels can represent are saturated, and NaN values are stored as the
+    offset. If return_error is true, a tuple of the scaled array and the
+    largest difference between a value and its quantized value is returned.
 
     >>> x = [1.25, 8.125, 6.75, 4.625, 9.25]
     >>> y = asscaledarray(x)
@@ -414,49 +1289,100 @@ def asscaledarray(x, forceoffset = None):
     5.25
     >>> q.offset
     1.3
+    >>> q, error = asscaledarray(x, return_error = True)
+    >>> error <= q.scale / 2
+    True
 
     """
+    cdef np.ndarray samples
+    cdef np.ndarray quantized
+    cdef SampleExtremes[float] floatextremes
+    cdef SampleExtremes[double] doubleextremes
+    cdef int64_t count
+    cdef double low, high, offset, scale
+    cdef double error = 0.
+
     if isinstance(x, scaledarray) and (
             forceoffset is None or forceoffset == x.offset):
         # nothing to do
-        return x
+        return (x, error) if return_error else x
+
+    samples = np.asarray(x)
+    if samples.dtype != np.float32:
+        samples = np.asarray(samples, dtype=np.float64)
+    samples = np.ascontiguousarray(samples,
+            dtype=samples.dtype.newbyteorder('='))
+    count = samples.size
+
+    if count == 0:
+        if forceoffset is None:
+            forceoffset = 0.
+        result = scaledarray(np.array([], dtype=np.int16), 1., forceoffset)
+    elif count == 1:
+        if forceoffset is None:
+            forceoffset = 0.
+        result = scaledarray(np.array([1], dtype=np.int16),
+                samples.flat[0] - forceoffset, forceoffset)
     else:
-        x = np.asarray(x)
-
-        if len(x) == 0:
-            if forceoffset is None:
-                forceoffset = 0.
-            return scaledarray(np.array([], dtype=np.int16), 1., forceoffset)
-        elif len(x) == 1:
-            if forceoffset is None:
-                forceoffset = 0.
-            return scaledarray(np.array([1], dtype=np.int16),
-                    x[0] - forceoffset, forceoffset)
+        # find the range of the values
+        if samples.dtype == np.float32:
+            with nogil:
+                FindSampleExtremes(<float*>samples.data, count,
+                        &floatextremes)
+            low, high = floatextremes.low, floatextremes.high
+        else:
+            with nogil:
+                FindSampleExtremes(<double*>samples.data, count,
+                        &doubleextremes)
+            low, high = doubleextremes.low, doubleextremes.high
+
+        if forceoffset is None:
+            forceoffset = (high + low)/2
+        offset = forceoffset
+        scale = max(high - offset, offset - low) / 32767
+        if not scale > 0:
+            # every value is the offset (or NaN)
+            scale = 1.
+
+        # quantize them
+        quantized = np.empty(samples.shape, dtype=np.int16)
+        if samples.dtype == np.float32:
+            with nogil:
+                QuantizeFloatArray(<float*>samples.data, count, scale,
+                        offset, <short*>quantized.data, &error)
         else:
-            if forceoffset is None:
-                forceoffset = (x.max() + x.min())/2
-            scale = np.max(np.abs(x - forceoffset)) / 32767
+            with nogil:
+                QuantizeDoubleArray(<double*>samples.data, count, scale,
+                        offset, <short*>quantized.data, &error)
+        result = scaledarray(quantized, scale, forceoffset)
+
+    return (result, error) if return_error else result
 
-            return scaledarray(
-                np.array((x - forceoffset) / scale).astype(np.int16),
-                scale, forceoffset)
 
 
+cdef prepare_columndata(ColumnData* columndata, colnum, fileformat, name, data,
+        series_tolerance=None):
+    """Use the data in a python sequence to fill out a C ColumnData struct
 
-cdef prepare_columndata(ColumnData* columndata, colnum, fileformat, name, data):
-    """Use the data in a python sequence to fill out a C ColumnData struct"""
-    cdef np.ndarray[np.int16_t, ndim=1] shortdata
-    cdef np.ndarray[np.int32_t, ndim=1] intdata
-    cdef np.ndarray[np.float32_t, ndim=1] floatdata
-    cdef np.ndarray[np.float64_t, ndim=1] doubledata
+    The sample arrays of the struct point straight into the memory of the
+    NumPy array returned (or None for a linear sequence), which must be kept
+    alive until the column has been written. Only the title is allocated, and
+    must be freed with free_columntitle.
 
-    memset(columndata, 0, sizeof(columndata))
+    """
+    cdef np.ndarray array = None
+    cdef int titlebytes
+
+    memset(columndata, 0, sizeof(ColumnData))
 
-    # fill in the column name
+    # fill in the column name; the older formats always read 80 bytes of it
     columndata.titleLength = 2*len(name)
-    columndata.title = <unsigned char*>malloc(columndata.titleLength+2)
+    titlebytes = max(columndata.titleLength + 2, 80)
+    columndata.title = <unsigned char*>malloc(titlebytes)
+    if columndata.title == NULL:
+        raise MemoryError()
+    memset(columndata.title, 0, titlebytes)
     memcpy(columndata.title, <char*>name, len(name))
-    columndata.title[len(name)] = 0
 
     # fill in the number of data points
     columndata.points = len(data)
@@ -470,6 +1396,14 @@ cdef prepare_columndata(ColumnData* columndata, colnum, fileformat, name, data):
             data = asscaledarray(data, forceoffset = 0.)
     elif fileformat == old_graph_format:
         data = np.asarray(data, dtype=np.float32)
+    elif colnum == 0 and series_tolerance is not None and not isinstance(
+            data, (linearsequence, scaledarray)):
+        # store a regularly spaced time column as a series
+        samples = np.asarray(data)
+        if samples.dtype.kind == 'f' and samples.dtype.itemsize in (4, 8):
+            sequence = find_linearsequence(samples, series_tolerance)
+            if sequence is not None:
+                data = sequence
 
     # create a column of the appropriate type
     if isinstance(data, linearsequence):
@@ -480,177 +1414,1422 @@ cdef prepare_columndata(ColumnData* columndata, colnum, fileformat, name, data):
         columndata.type = ScaledShortArrayType
         columndata.scaledShortArray.scale = data.scale
         columndata.scaledShortArray.offset = data.offset
-        shortdata = data.data
-        columndata.scaledShortArray.shortArray = <short*>malloc(
-                columndata.points * sizeof(short))
-        memcpy(columndata.scaledShortArray.shortArray,
-                <short*>shortdata.data,
-                columndata.points * sizeof(short))
+        array = np.ascontiguousarray(data.data, dtype=np.int16)
+        columndata.scaledShortArray.shortArray = <short*>array.data
     else:
-        # convert it to an array for further processing
+        # convert it to a contiguous array in native byte order; this only
+        # copies the data if it is not already laid out that way
         array = np.asarray(data)
+        array = np.ascontiguousarray(array,
+                dtype=array.dtype.newbyteorder('='))
 
         if array.dtype == np.int16:
             columndata.type = ShortArrayType
-            shortdata = array
-            columndata.shortArray = <short*>malloc(
-                    columndata.points * sizeof(short))
-            memcpy(columndata.shortArray, <short*>shortdata.data,
-                    columndata.points * sizeof(short))
+            columndata.shortArray = <short*>array.data
         elif array.dtype == np.int32:
             columndata.type = IntArrayType
-            intdata = array
-            columndata.intArray = <int32_t*>malloc(
-                    columndata.points * sizeof(int32_t))
-            memcpy(columndata.intArray, <int32_t*>intdata.data,
-                    columndata.points * sizeof(int32_t))
+            columndata.intArray = <int32_t*>array.data
         elif array.dtype == np.float32:
             columndata.type = FloatArrayType
-            floatdata = array
-            columndata.floatArray = <float*>malloc(
-                    columndata.points * sizeof(float))
-            memcpy(columndata.floatArray, <float*>floatdata.data,
-                    columndata.points * sizeof(float))
+            columndata.floatArray = <float*>array.data
         elif array.dtype == np.float64:
             columndata.type = DoubleArrayType
-            doubledata = array
-            columndata.doubleArray = <double*>malloc(
-                    columndata.points * sizeof(double))
-            memcpy(columndata.doubleArray, <double*>doubledata.data,
-                    columndata.points * sizeof(double))
+            columndata.doubleArray = <double*>array.data
         else:
             raise TypeError("Unsupported column data type %s"
                     % repr(array.dtype))
 
-
-
-cdef convert_columndata(ColumnData* columndata):
-    """Convert the data in a C ColumnData struct to a python sequence"""
-    cdef np.ndarray[np.int16_t, ndim=1] shortdata
-    cdef np.ndarray[np.int32_t, ndim=1] intdata
-    cdef np.ndarray[np.float32_t, ndim=1] floatdata
-    cdef np.ndarray[np.float64_t, ndim=1] doubledata
-
-    if columndata.type == ShortArrayType:
-        shortdata = np.empty(columndata.points, dtype = np.int16)
-        memcpy(shortdata.data, columndata.shortArray,
-                columndata.points * sizeof(short))
-        return shortdata
-    elif columndata.type == IntArrayType:
-        intdata = np.empty(columndata.points, dtype = np.int32)
-        memcpy(intdata.data, columndata.intArray,
-                columndata.points * sizeof(int32_t))
-        return intdata
-    elif columndata.type == FloatArrayType:
-        floatdata = np.empty(columndata.points, dtype = np.float32)
-        memcpy(floatdata.data, columndata.floatArray,
-                columndata.points * sizeof(float))
-        return floatdata
-    elif columndata.type == DoubleArrayType:
-        doubledata = np.empty(columndata.points, dtype = np.float64)
-        memcpy(doubledata.data, columndata.doubleArray,
-                columndata.points * sizeof(double))
-        return doubledata
-    elif columndata.type == SeriesArrayType:
-        return linearsequence(columndata.points,
-                columndata.seriesArray.firstValue,
-                columndata.seriesArray.increment)
-    elif columndata.type == ScaledShortArrayType:
-        shortdata = np.empty(columndata.points, dtype = np.int16)
-        memcpy(shortdata.data, columndata.scaledShortArray.shortArray,
-                columndata.points * sizeof(short))
-        return scaledarray(shortdata, columndata.scaledShortArray.scale,
-            columndata.scaledShortArray.offset)
-    else:
-        raise IOError('Unsupported column type %d' % columndata.type)
+    return array
 
 
 
-cdef free_columndata(ColumnData* columndata):
-    """Free the memory used by a columndata structure"""
+cdef free_columntitle(ColumnData* columndata):
+    """Free the title allocated by prepare_columndata"""
 
     free(<char*>columndata.title)
     columndata.title = NULL
     columndata.titleLength = 0
 
-    if columndata.type == ShortArrayType:
-        free(columndata.shortArray)
-        columndata.shortArray = NULL
-    elif columndata.type == IntArrayType:
-        free(columndata.intArray)
-        columndata.intArray = NULL
-    elif columndata.type == FloatArrayType:
-        free(columndata.floatArray)
-        columndata.floatArray = NULL
-    elif columndata.type == DoubleArrayType:
-        free(columndata.doubleArray)
-        columndata.doubleArray = NULL
-    elif columndata.type == SeriesArrayType:
-        pass
-    elif columndata.type == ScaledShortArrayType:
-        free(columndata.scaledShortArray.shortArray)
-        columndata.scaledShortArray.shortArray = NULL
+
+
+cdef class _mappedfile:
+    """A read-only memory mapping of an Axograph file
+
+    The mapping exposes the raw bytes of the file through the buffer
+    protocol, so NumPy arrays created from it share the mapping's memory and
+    keep it open for as long as they exist.
+
+    """
+    cdef AGDataRef file
+    cdef char* base
+    cdef Py_ssize_t size
+
+    def __cinit__(self, char* filename):
+        cdef int64_t count = LLONG_MAX
+        cdef const_void_ptr base = NULL
+
+        with nogil:
+            self.file = OpenMappedFile(filename)
+        if self.file == NULL:
+            raise IOError('file not found')
+
+        # map the whole file to find where it starts and how long it is
+        MapFromFile(self.file, &count, &base)
+        SetFilePosition(self.file, 0)
+        self.base = <char*>base
+        self.size = count
+
+    def __dealloc__(self):
+        if self.file != NULL:
+            with nogil:
+                CloseFile(self.file)
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        PyBuffer_FillInfo(buffer, self, self.base, self.size, 1, flags)
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+    cdef array(self, void* data, dtype, count):
+        """Wrap count samples at data as a read-only array without copying"""
+        return np.frombuffer(self, dtype=dtype, count=count,
+                offset=<char*>data - self.base)
+
+    cdef view(self, ColumnData* columndata):
+        """Wrap a column read by AG_MapColumn as a python sequence"""
+        if columndata.type == ShortArrayType:
+            return self.array(columndata.shortArray, '>i2',
+                    columndata.points)
+        elif columndata.type == IntArrayType:
+            return self.array(columndata.intArray, '>i4', columndata.points)
+        elif columndata.type == FloatArrayType:
+            return self.array(columndata.floatArray, '>f4',
+                    columndata.points)
+        elif columndata.type == DoubleArrayType:
+            return self.array(columndata.doubleArray, '>f8',
+                    columndata.points)
+        elif columndata.type == SeriesArrayType:
+            return linearsequence(columndata.points,
+                    columndata.seriesArray.firstValue,
+                    columndata.seriesArray.increment)
+        elif columndata.type == ScaledShortArrayType:
+            return scaledarray(
+                self.array(columndata.scaledShortArray.shortArray, '>i2',
+                    columndata.points),
+                columndata.scaledShortArray.scale,
+                columndata.scaledShortArray.offset)
+        else:
+            raise IOError('Unsupported column type %d' % columndata.type)
+
+
+
+cdef class _mallocbuffer:
+    """A block of memory allocated with malloc, freed with this object
+
+    Supports the buffer protocol, so NumPy arrays can be created on top of
+    it with np.frombuffer; they keep it alive for as long as they exist.
+
+    """
+    cdef void* data
+    cdef Py_ssize_t size
+
+    def __dealloc__(self):
+        free(self.data)
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        PyBuffer_FillInfo(buffer, self, self.data, self.size, 0, flags)
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+
+
+cdef take_columndata(ColumnData* columndata):
+    """Convert a column read by AG_ReadColumn to a python sequence, taking
+    over its sample array instead of copying it"""
+    cdef _mallocbuffer buffer
+    cdef void* array
+
+    if columndata.type == SeriesArrayType:
+        return linearsequence(columndata.points,
+                columndata.seriesArray.firstValue,
+                columndata.seriesArray.increment)
+    elif columndata.type == ShortArrayType:
+        array = columndata.shortArray
+        columndata.shortArray = NULL
+    elif columndata.type == IntArrayType:
+        array = columndata.intArray
+        columndata.intArray = NULL
+    elif columndata.type == FloatArrayType:
+        array = columndata.floatArray
+        columndata.floatArray = NULL
+    elif columndata.type == DoubleArrayType:
+        array = columndata.doubleArray
+        columndata.doubleArray = NULL
+    elif columndata.type == ScaledShortArrayType:
+        array = columndata.scaledShortArray.shortArray
+        columndata.scaledShortArray.shortArray = NULL
     else:
         raise IOError('Unsupported column type %d' % columndata.type)
 
+    dtype = np.dtype(_column_dtypes[columndata.type])
+    buffer = _mallocbuffer()
+    buffer.data = array
+    buffer.size = columndata.points * dtype.itemsize
+    data = np.frombuffer(buffer, dtype = dtype)
+
+    if columndata.type == ScaledShortArrayType:
+        return scaledarray(data, columndata.scaledShortArray.scale,
+                columndata.scaledShortArray.offset)
+    else:
+        return data
+
+
+
+cdef copy_columndata(const_columndata_ptr columndata):
+    """Convert a column whose sample array belongs to someone else (such as
+    a chunk read by AG_ReadChunk) to a python sequence, copying the array"""
+    cdef np.ndarray data
+    cdef void* array
+
+    if columndata.type == SeriesArrayType:
+        return linearsequence(columndata.points,
+                columndata.seriesArray.firstValue,
+                columndata.seriesArray.increment)
+    elif columndata.type == ShortArrayType:
+        array = columndata.shortArray
+    elif columndata.type == IntArrayType:
+        array = columndata.intArray
+    elif columndata.type == FloatArrayType:
+        array = columndata.floatArray
+    elif columndata.type == DoubleArrayType:
+        array = columndata.doubleArray
+    elif columndata.type == ScaledShortArrayType:
+        array = columndata.scaledShortArray.shortArray
+    else:
+        raise IOError('Unsupported column type %d' % columndata.type)
+
+    data = np.empty(columndata.points,
+            dtype = _column_dtypes[columndata.type])
+    memcpy(data.data, array, data.nbytes)
+
+    if columndata.type == ScaledShortArrayType:
+        return scaledarray(data, columndata.scaledShortArray.scale,
+                columndata.scaledShortArray.offset)
+    else:
+        return data
+
+
+
+def _index_error(result):
+    """Create the exception for an error from AG_BuildColumnIndex"""
+    if result == kAG_FormatErr or result == kAG_VersionErr:
+        return IOError('file is not in AxoGraph format, or is damaged')
+    else:
+        return IOError((result,
+            'AG_BuildColumnIndex returned error %d' % result))
+
+
+
+cdef column_title(ColumnData* columndata):
+    """Get the title of a column as a python string"""
+    if <char*>columndata.title is None:
+        return ''
+    else:
+        return <char*>(columndata.title)
+
+
+
+cdef index_columns(ColumnIndex* index):
+    """Describe each column of a column index with a column_info object"""
+    cdef ColumnIndexEntry* entry
+
+    columns = []
+    for colnum in range(index.numberOfColumns):
+        entry = &index.columns[colnum]
+        columns += [column_info(column_title(&entry.column),
+            entry.column.type, entry.column.points, entry.dataPosition,
+            entry.dataBytes)]
+    return columns
+
+
+
+_string_types = (str, type(u''))
+
+def _select_columns(columns, selection):
+    """Find the column numbers picked out by the columns argument of read()
+
+    >>> columns = [column_info(name, 6, 10, 0, 40)
+    ...     for name in ['Time (s)', 'Current (A)', 'Voltage (V)', '']]
+    >>> _select_columns(columns, None)
+    [0, 1, 2, 3]
+    >>> _select_columns(columns, [2, 0])
+    [0, 2]
+    >>> _select_columns(columns, ['Current (A)', -1])
+    [1, 3]
+    >>> _select_columns(columns, 'Voltage (V)')
+    [2]
+    >>> _select_columns(columns, lambda c: c.name.startswith('V'))
+    [2]
+    >>> _select_columns(columns, [4])
+    Traceback (most recent call last):
+        ...
+    IndexError: column index out of range
+    >>> _select_columns(columns, ['Time (ms)'])
+    Traceback (most recent call last):
+        ...
+    KeyError: "no column named 'Time (ms)'"
+
+    """
+    n = len(columns)
+    if selection is None:
+        return list(range(n))
+    elif callable(selection):
+        return [i for i in range(n) if selection(columns[i])]
+    elif isinstance(selection, _string_types) or np.ndim(selection) == 0:
+        selection = [selection]
+
+    selected = set()
+    for item in selection:
+        if isinstance(item, _string_types):
+            matches = [i for i in range(n) if columns[i].name == item]
+            if not matches:
+                raise KeyError('no column named %r' % item)
+            selected.update(matches)
+        else:
+            i = int(item)
+            if i < -n or i >= n:
+                raise IndexError('column index out of range')
+            selected.add(i % n)
+    return sorted(selected)
+
+
+
+def _column_ranges(ranges, n):
+    """Expand the ranges argument of read() to one range per column
+
+    A single range (a slice or a (start, stop) tuple) applies to every
+    column; a list gives one range (or None) for each column.
+
+    >>> _column_ranges(None, 2)
+    [None, None]
+    >>> _column_ranges((10, 20), 2)
+    [slice(10, 20, None), slice(10, 20, None)]
+    >>> _column_ranges([None, slice(-5, None)], 2)
+    [None, slice(-5, None, None)]
+    >>> _column_ranges([(1, 2)], 2)
+    Traceback (most recent call last):
+        ...
+    ValueError: expected 2 ranges, one for each column
+
+    """
+    if ranges is None or isinstance(ranges, (slice, tuple)):
+        ranges = [ranges] * n
+    elif len(ranges) != n:
+        raise ValueError('expected %d ranges, one for each column' % n)
+    return [slice(*r) if isinstance(r, tuple) else r for r in ranges]
+
+
+
+def _range_bounds(range_, points):
+    """Find the (start, stop) sample numbers of a slice of a column
+
+    >>> _range_bounds(slice(10, 20), 100)
+    (10, 20)
+    >>> _range_bounds(slice(-10, None), 100)
+    (90, 100)
+    >>> _range_bounds(slice(50, 200), 100)
+    (50, 100)
+    >>> _range_bounds(slice(0, 10, 2), 100)
+    Traceback (most recent call last):
+        ...
+    ValueError: ranges must have a step of 1
+
+    """
+    start, stop, step = range_.indices(points)
+    if step != 1:
+        raise ValueError('ranges must have a step of 1')
+    return start, max(start, stop)
+
+
+
+def _slice_column(data, start, stop):
+    """Take samples start <= i < stop of a column without copying them"""
+    if isinstance(data, linearsequence):
+        return linearsequence(stop - start, data.start + start * data.step,
+                data.step)
+    elif isinstance(data, scaledarray):
+        return scaledarray(data.data[start:stop], data.scale, data.offset)
+    else:
+        return data[start:stop]
+
+
+
+def read_header(char* filename):
+    """Read the column directory of an Axograph file
+
+    Only the column headers are read from disk; the sample data is skipped,
+    so this is fast even for very large files. Returns an
+    axographio.file_header object.
+
+    """
+    cdef int result
+    cdef ColumnIndex index
+
+    cdef AGDataRef file
+
+    # open the file
+    with nogil:
+        file = OpenFile(filename)
+    if file == NULL:
+        raise IOError('file not found')
+
+    try:
+        with nogil:
+            result = AG_BuildColumnIndex(file, &index)
+        try:
+            if result != 0:
+                raise _index_error(result)
+            columns = index_columns(&index)
+        finally:
+            AG_FreeColumnIndex(&index)
+    finally:
+        with nogil:
+            CloseFile(file)
+
+    return file_header([c.name for c in columns], columns, index.fileFormat)
+
+
+
+cdef trailer_string(unsigned char* string):
+    """Get a string from an Axograph file trailer as a python string"""
+    return (<bytes>(<char*>string)).decode('latin-1')
+
+
+
+cdef trailer_contents(AGTrailer* trailer):
+    """Describe a trailer read by AG_ReadTrailer with a file_trailer object"""
+    cdef AGTraceHeader* trace
+    cdef int32_t t
+
+    traces = []
+    for t in range(trailer.numberOfTraces):
+        trace = &trailer.traces[t]
+        traces += [trace_header(trace.xColumn, trace.yColumn,
+            trace.errorBarColumn, trace.negativeErrorBarColumn,
+            trace.group, trace.shown, trace.minX, trace.maxX,
+            trace.minPositiveX, trace.xRegularlySpaced,
+            trace.xMonotonic, trace.xInterval, trace.minY,
+            trace.maxY, trace.minPositiveY)]
+    return file_trailer(trailer_string(trailer.comment),
+            trailer_string(trailer.notes), traces)
+
+
+
+def read_trailer(char* filename):
+    """Read the comment, notes, and trace headers of an Axograph file
+
+    Only the column headers and the trailer stored after the last column are
+    read from disk; the sample data is skipped. The trace headers include
+    the range of each trace's X and Y values, as stored by AxoGraph, so axes
+    can be set up without reading any samples. Files in the older formats,
+    and files written without a trailer, have an empty comment and notes
+    and no traces. Returns an axographio.file_trailer object.
+
+    """
+    cdef int indexresult
+    cdef int result = 0
+    cdef ColumnIndex index
+    cdef AGTrailer trailer
+    cdef AGDataRef file
+
+    memset(&trailer, 0, sizeof(AGTrailer))
+
+    # open the file
+    with nogil:
+        file = OpenFile(filename)
+    if file == NULL:
+        raise IOError('file not found')
+
+    try:
+        with nogil:
+            indexresult = AG_BuildColumnIndex(file, &index)
+            if indexresult == 0:
+                result = AG_ReadTrailer(file, &index, &trailer)
+        try:
+            if indexresult != 0:
+                raise _index_error(indexresult)
+            elif result != 0:
+                raise IOError((result,
+                    'AG_ReadTrailer returned error %d' % result))
+            contents = trailer_contents(&trailer)
+        finally:
+            AG_FreeTrailer(&trailer)
+            AG_FreeColumnIndex(&index)
+    finally:
+        with nogil:
+            CloseFile(file)
+
+    return contents
+
+
+
+# NumPy types of the sample arrays of each column type
+_column_dtypes = {
+    ShortArrayType: np.int16,
+    IntArrayType: np.int32,
+    FloatArrayType: np.float32,
+    DoubleArrayType: np.float64,
+    ScaledShortArrayType: np.int16,
+    }
+
+cdef read_column(AGDataRef file, ColumnIndex* index, int colnum,
+        int32_t start, int32_t stop):
+    """Read samples start <= i < stop of an indexed column as a python
+    sequence, decoding them directly into a new NumPy array"""
+    cdef ColumnData* column = &index.columns[colnum].column
+    cdef np.ndarray data
+    cdef void* samples
+    cdef int result
+
+    if column.type == SeriesArrayType:
+        return linearsequence(stop - start,
+                column.seriesArray.firstValue
+                    + start * column.seriesArray.increment,
+                column.seriesArray.increment)
+    elif column.type not in _column_dtypes:
+        raise IOError('Unsupported column type %d' % column.type)
+
+    data = np.empty(stop - start, dtype = _column_dtypes[column.type])
+    samples = data.data
+    with nogil:
+        result = AG_ReadColumnRangeInto(file, index, colnum, start, stop,
+                samples)
+    if result != 0:
+        raise IOError((result, 'AG_ReadColumn returned error %d' % result))
+
+    if column.type == ScaledShortArrayType:
+        return scaledarray(data, column.scaledShortArray.scale,
+                column.scaledShortArray.offset)
+    else:
+        return data
+
+
+
+cdef read_converted_column(AGDataRef file, ColumnIndex* index, int colnum,
+        int32_t start, int32_t stop, dtype):
+    """Read samples start <= i < stop of an indexed column into a new
+    np.float32 or np.float64 array, converting them as they are read"""
+    cdef np.ndarray data = np.empty(stop - start, dtype = dtype)
+    cdef void* samples = data.data
+    cdef bint single = dtype == np.float32
+    cdef int result
+
+    with nogil:
+        if single:
+            result = AG_ReadColumnAsFloat(file, index, colnum, start, stop,
+                    <float*>samples)
+        else:
+            result = AG_ReadColumnAsDouble(file, index, colnum, start, stop,
+                    <double*>samples)
+    if result != 0:
+        raise IOError((result, 'AG_ReadColumn returned error %d' % result))
+    return data
+
+
+
+cdef read_parallel(AGDataRef file, ColumnIndex* index, selected,
+        colranges, dtype, int threads):
+    """Read the selected columns, each clipped to its range (or None), into
+    new arrays on a pool of native threads, converting them to dtype if it
+    is not None"""
+    cdef AGColumnRead* reads
+    cdef ColumnData* column
+    cdef np.ndarray data
+    cdef int32_t numreads = len(selected)
+    cdef int arraytype = 0
+    cdef int result
+    cdef int32_t i
+
+    if dtype == np.float32:
+        arraytype = FloatArrayType
+    elif dtype == np.float64:
+        arraytype = DoubleArrayType
+
+    reads = <AGColumnRead*>malloc((numreads + 1) * sizeof(AGColumnRead))
+    if reads == NULL:
+        raise MemoryError()
+    try:
+        coldata = []
+        for i in range(numreads):
+            column = &index.columns[selected[i]].column
+            reads[i].columnNumber = selected[i]
+            if colranges[i] is None:
+                reads[i].start, reads[i].stop = 0, column.points
+            else:
+                reads[i].start, reads[i].stop = _range_bounds(colranges[i],
+                        column.points)
+            reads[i].array = NULL
+
+            if arraytype == 0 and column.type == SeriesArrayType:
+                coldata += [linearsequence(reads[i].stop - reads[i].start,
+                    column.seriesArray.firstValue
+                        + reads[i].start * column.seriesArray.increment,
+                    column.seriesArray.increment)]
+                continue
+            elif arraytype == 0 and column.type not in _column_dtypes:
+                raise IOError('Unsupported column type %d' % column.type)
+            data = np.empty(reads[i].stop - reads[i].start, dtype = dtype
+                    if arraytype != 0 else _column_dtypes[column.type])
+            reads[i].array = data.data
+            if arraytype == 0 and column.type == ScaledShortArrayType:
+                coldata += [scaledarray(data, column.scaledShortArray.scale,
+                    column.scaledShortArray.offset)]
+            else:
+                coldata += [data]
+
+        with nogil:
+            result = AG_ReadColumnsParallel(file, index, reads, numreads,
+                    arraytype, threads)
+        if result != 0:
+            raise IOError((result, 'AG_ReadColumn returned error %d' % result))
+    finally:
+        free(reads)
+
+    return coldata
+
+
+
+cdef class _indexedfile:
+    """An open Axograph file and its column index, from which columns can
+    be read on demand
+
+    The file is opened for positioned reads, which share no file position,
+    so columns can be read from several threads at once. The lock only
+    guards the count of reads in progress, which close waits for.
+
+    """
+    cdef AGDataRef file
+    cdef ColumnIndex index
+    cdef bint indexed
+    cdef object lock
+    cdef int readers
+
+    def __cinit__(self, char* filename):
+        cdef int result
+
+        self.indexed = False
+        self.readers = 0
+        self.lock = threading.Condition()
+        with nogil:
+            self.file = OpenPositionedFile(filename)
+        if self.file == NULL:
+            raise IOError('file not found')
+
+        with nogil:
+            result = AG_BuildColumnIndex(self.file, &self.index)
+        if result != 0:
+            AG_FreeColumnIndex(&self.index)
+            raise _index_error(result)
+        self.indexed = True
+
+    def __dealloc__(self):
+        self.release()
+
+    def close(self):
+        """Close the file, once any reads in progress have finished; columns
+        can no longer be read"""
+        with self.lock:
+            while self.readers > 0:
+                self.lock.wait()
+            self.release()
+
+    cdef release(self):
+        if self.indexed:
+            AG_FreeColumnIndex(&self.index)
+            self.indexed = False
+        if self.file != NULL:
+            with nogil:
+                CloseFile(self.file)
+            self.file = NULL
+
+    property fileformat:
+        def __get__(self):
+            return self.index.fileFormat
+
+    def columns(self):
+        """The column_info of each column in the file"""
+        return index_columns(&self.index)
+
+    def read(self, int colnum, dtype = None):
+        """Read a whole column, as in read()"""
+        cdef int32_t points
+
+        with self.lock:
+            if not self.indexed:
+                raise ValueError('file is closed')
+            points = self.index.columns[colnum].column.points
+            self.readers += 1
+        try:
+            if dtype is not None:
+                return read_converted_column(self.file, &self.index, colnum,
+                        0, points, dtype)
+            else:
+                return read_column(self.file, &self.index, colnum, 0, points)
+        finally:
+            with self.lock:
+                self.readers -= 1
+                self.lock.notify_all()
+
+
+
+def _column_nbytes(data):
+    """The memory used by a column read from a file"""
+    if isinstance(data, scaledarray):
+        return data.data.nbytes
+    elif isinstance(data, np.ndarray):
+        return data.nbytes
+    else:
+        return 0
+
+
+
+class _lazy_columns:
+    """The columns of a lazily read Axograph file
+
+    Each column is read from the file when it is first accessed, then kept
+    in a cache. If cache_bytes is given, the least recently used columns
+    are dropped from the cache (to be read again if needed) whenever the
+    cached columns take up more memory than that; the column just read is
+    always kept.
+
+    """
+    def __init__(self, reader, selected, dtype, cache_bytes):
+        self._reader = reader
+        self._selected = selected
+        self._dtype = dtype
+        self._cache_bytes = cache_bytes
+        self._cache = collections.OrderedDict()
+        self._cached_bytes = 0
+        self._lock = threading.Lock()
+
+    def __len__(self):
+        return len(self._selected)
+
+    def __getitem__(self, index):
+        if isinstance(index, slice):
+            return [self[i] for i in range(*index.indices(len(self)))]
+        n = len(self._selected)
+        index = int(index)
+        if index < -n or index >= n:
+            raise IndexError('column index out of range')
+        index %= n
+
+        with self._lock:
+            if index in self._cache:
+                data = self._cache.pop(index)
+                self._cache[index] = data
+                return data
+
+        data = self._reader.read(self._selected[index], self._dtype)
+
+        with self._lock:
+            if index not in self._cache:
+                self._cache[index] = data
+                self._cached_bytes += _column_nbytes(data)
+            while (self._cache_bytes is not None and len(self._cache) > 1
+                    and self._cached_bytes > self._cache_bytes):
+                _, evicted = self._cache.popitem(last = False)
+                self._cached_bytes -= _column_nbytes(evicted)
+        return data
+
+    def __iter__(self):
+        return _getitem_iterator(self)
+
+    def cached(self):
+        """The numbers of the columns currently held in the cache, from
+        least to most recently used"""
+        with self._lock:
+            return list(self._cache.keys())
 
 
-def read(char* filename):
+
+class lazy_file_contents(file_contents):
+    """The contents of an axograph data file, read on demand
+
+    Returned by read() with lazy=True. names is available at once, but data
+    is a sequence whose columns are read from the still-open file the first
+    time they are accessed (see read). The file stays open until close() is
+    called, or the object is used as a context manager and its block ends.
+
+    """
+    def __init__(self, reader, selected, dtype = None, cache_bytes = None):
+        columns = reader.columns()
+        file_contents.__init__(self, [columns[i].name for i in selected],
+                _lazy_columns(reader, selected, dtype, cache_bytes),
+                reader.fileformat)
+        self._reader = reader
+
+    def close(self):
+        """Close the file; columns not yet read can no longer be read"""
+        self._reader.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+
+def read(char* filename, mmap = False, columns = None, ranges = None,
+        dtype = None, lazy = False, cache_bytes = None, threads = None):
     """Read an Axograph file
 
     Read an Axograph file from disk and return the contents as an
     axographio.file_contents object.
 
+    If mmap is True, the file is memory-mapped instead of read, and array
+    columns are returned as read-only NumPy arrays that share memory with
+    the mapping. No data is copied or byte swapped, so these arrays have a
+    big-endian dtype (e.g., '>i2', '>f4', or '>f8'); the mapping stays
+    open for as long as any of them exist.
+
+    If columns is given, only the selected columns are read, and the sample
+    data of all other columns is skipped over without being read. Columns
+    can be selected by index, by name (all columns with that name), or by a
+    list mixing the two; alternatively, columns can be a function that is
+    passed the column_info of each column (see read_header) and returns
+    True for the columns to be read. Selected columns are always returned
+    in the order they appear in the file.
+
+    If ranges is given, only part of each column is read: either a single
+    range applied to every column, or a list with one range (or None, for
+    the whole column) for each selected column. A range is a slice or a
+    (start, stop) tuple of sample numbers, interpreted like a Python slice
+    with a step of 1. The reads seek directly to the first sample in the
+    range, and linear sequences are sliced without reading anything.
+
+    If dtype is np.float32 or np.float64, every column is returned as a
+    plain array of that type instead: scaled arrays are scaled, linear
+    sequences are expanded, and integer columns are converted without
+    scaling. The samples are byte swapped and converted as they are read,
+    straight into the returned arrays, without a temporary copy of each
+    column. This works with mmap, columns, and ranges.
+
+    If lazy is True, only the column headers are read at first, and an
+    axographio.lazy_file_contents object is returned, whose names are
+    available at once but whose data columns are each read the first time
+    they are accessed, then cached. cache_bytes optionally limits the memory
+    used by the cached columns; beyond it, the least recently used ones are
+    dropped, to be read again when next accessed. This works with columns
+    and dtype, but not with mmap or ranges. The file stays open until the
+    object's close method is called. Its reads are positioned, without a
+    shared file position, so different columns can be read at once from
+    several Python threads.
+
+    If threads is given, the selected columns are read, byte swapped and
+    converted on a pool of that many native threads (or one per processor,
+    if it is 0), which take pieces of at most a million samples of one
+    column at a time, so a single very long column is shared between them.
+    The file is opened for positioned reads, which the threads make at once.
+    This works with columns, ranges, and dtype, and with mmap if dtype is
+    given (otherwise there is nothing to decode), but not with lazy.
+
+    The file is read and decoded without holding the global interpreter
+    lock, so many files can be read at once from several Python threads.
+
     """
-    cdef int fileformat = 0
     cdef int result
-    cdef int32_t numcolumns
+    cdef ColumnIndex index
     cdef ColumnData columndata
-    cdef unsigned int i
+    cdef AGDataRef file
+    cdef _mappedfile mapping = None
+    cdef int colnum
+    cdef int32_t start, stop
+
+    if dtype is not None:
+        dtype = np.dtype(dtype)
+        if dtype != np.float32 and dtype != np.float64:
+            raise ValueError('dtype must be np.float32 or np.float64')
+
+    if lazy:
+        if mmap or ranges is not None or threads is not None:
+            raise ValueError('lazy reads cannot be combined with mmap, '
+                    'ranges or threads')
+        reader = _indexedfile(filename)
+        try:
+            selected = _select_columns(reader.columns(), columns)
+        except:
+            reader.close()
+            raise
+        return lazy_file_contents(reader, selected, dtype, cache_bytes)
+
+    # open the file
+    if mmap:
+        mapping = _mappedfile(filename)
+        file = mapping.file
+    elif threads is not None:
+        with nogil:
+            file = OpenPositionedFile(filename)
+        if file == NULL:
+            raise IOError('file not found')
+    else:
+        with nogil:
+            file = OpenFile(filename)
+        if file == NULL:
+            raise IOError('file not found')
+
+    try:
+        # figure out the file format and where each column is
+        with nogil:
+            result = AG_BuildColumnIndex(file, &index)
+        try:
+            if result != 0:
+                raise _index_error(result)
+
+            # read in each selected column of data
+            selected = _select_columns(index_columns(&index), columns)
+            if threads is not None and (dtype is not None
+                    or mapping is None):
+                colnames = [column_title(&index.columns[colnum].column)
+                        for colnum in selected]
+                coldata = read_parallel(file, &index, selected,
+                        _column_ranges(ranges, len(selected)), dtype,
+                        threads)
+            else:
+                colnames = []
+                coldata = []
+                for colnum, colrange in zip(selected,
+                        _column_ranges(ranges, len(selected))):
+                    if colrange is None:
+                        start = 0
+                        stop = index.columns[colnum].column.points
+                    else:
+                        start, stop = _range_bounds(colrange,
+                                index.columns[colnum].column.points)
+
+                    colnames += [column_title(&index.columns[colnum].column)]
+                    if dtype is not None:
+                        coldata += [read_converted_column(file, &index,
+                            colnum, start, stop, dtype)]
+                    elif mapping is None:
+                        coldata += [read_column(file, &index, colnum,
+                            start, stop)]
+                    else:
+                        with nogil:
+                            result = AG_SeekColumn(file, &index, colnum)
+                            if result == 0:
+                                result = AG_MapColumn(file, index.fileFormat,
+                                        colnum, &columndata)
+                        if result != 0:
+                            raise IOError((result,
+                                'AG_ReadColumn returned error %d' % result))
+
+                        # only the title was allocated; the data is in the
+                        # mapping
+                        data = mapping.view(&columndata)
+                        if colrange is not None:
+                            data = _slice_column(data, start, stop)
+                        coldata += [data]
+                        free(<char*>columndata.title)
+        finally:
+            AG_FreeColumnIndex(&index)
+
+    finally:
+        if mapping is None:
+            with nogil:
+                CloseFile(file)
+
+    return file_contents(colnames, coldata, index.fileFormat)
+
+
+
+def read_matrix(char* filename, dtype = np.float32):
+    """Read every sweep of an episodic Axograph file into one 2D array
+
+    The first column of the file is taken to be the time column shared by
+    the sweeps in all the other columns, which must each have as many points
+    as it. Returns an axographio.sweep_matrix, whose data is a new array of
+    the given dtype (np.float32 or np.float64) with one row per sweep.
+
+    Each sweep is byte swapped and converted (and scaled, for scaled int16
+    columns) as it is read, straight into its row of the array, so this is
+    much faster than reading the columns and stacking them. This is done
+    without holding the global interpreter lock.
+
+    """
+    cdef int result
+    cdef ColumnIndex index
+    cdef AGDataRef file
+    cdef np.ndarray data
+    cdef void* samples
+    cdef int32_t numsweeps, points
+    cdef bint single
+
+    dtype = np.dtype(dtype)
+    if dtype != np.float32 and dtype != np.float64:
+        raise ValueError('dtype must be np.float32 or np.float64')
+    single = dtype == np.float32
 
     # open the file
-    cdef AGDataRef file = OpenFile(filename)
+    with nogil:
+        file = OpenFile(filename)
     if file == NULL:
         raise IOError('file not found')
 
     try:
-        # figure out the file format
-        result = AG_GetFileFormat( file, &fileformat )
-        if result != 0:
-            if result == kAG_FormatErr:
-                raise IOError('file is not in AxoGraph format')
-            elif result == kAG_VersionErr:
-                raise IOError('file is not in AxoGraph format')
-            else:
+        with nogil:
+            result = AG_BuildColumnIndex(file, &index)
+        try:
+            if result != 0:
+                raise _index_error(result)
+            if AG_GetMatrixShape(&index, &numsweeps, &points) != 0:
+                raise ValueError('file does not have sweeps the same length '
+                        'as its time column')
+
+            colnames = [column_title(&index.columns[colnum].column)
+                    for colnum in range(index.numberOfColumns)]
+            time = read_column(file, &index, 0, 0, points)
+
+            data = np.empty((numsweeps, points), dtype = dtype)
+            samples = data.data
+            with nogil:
+                if single:
+                    result = AG_ReadMatrixAsFloat(file, &index,
+                            <float*>samples)
+                else:
+                    result = AG_ReadMatrixAsDouble(file, &index,
+                            <double*>samples)
+            if result != 0:
                 raise IOError((result,
-                    'AG_GetFileFormat returned error %d' % result))
+                    'AG_ReadMatrix returned error %d' % result))
+        finally:
+            AG_FreeColumnIndex(&index)
+
+    finally:
+        with nogil:
+            CloseFile(file)
+
+    return sweep_matrix(colnames, time, data, index.fileFormat)
+
+
+
+cdef class _chunkreader:
+    """An open Axograph file, its column index and an AG_ChunkReader over
+    some of its columns; iterating over it yields a file_chunk for each
+    chunk, and closes the file after the last one"""
+    cdef AGDataRef file
+    cdef ColumnIndex index
+    cdef bint indexed
+    cdef AGChunkReader* reader
+    cdef object names
 
-        # read in the number of columns
-        result = AG_GetNumberOfColumns(file, fileformat, &numcolumns)
+    def __cinit__(self, char* filename, columns, int32_t chunk_points,
+            int arraytype):
+        cdef int result
+        cdef int32_t* colnums
+        cdef int32_t numcols
+        cdef int32_t i
+
+        self.indexed = False
+        self.reader = NULL
+        with nogil:
+            self.file = OpenFile(filename)
+        if self.file == NULL:
+            raise IOError('file not found')
+
+        with nogil:
+            result = AG_BuildColumnIndex(self.file, &self.index)
+        self.indexed = True
         if result != 0:
+            raise _index_error(result)
+
+        selected = _select_columns(index_columns(&self.index), columns)
+        self.names = [column_title(&self.index.columns[i].column)
+                for i in selected]
+        numcols = len(selected)
+        colnums = <int32_t*>malloc((numcols + 1) * sizeof(int32_t))
+        if colnums == NULL:
+            raise MemoryError()
+        for i in range(numcols):
+            colnums[i] = selected[i]
+        with nogil:
+            self.reader = AG_OpenChunkReader(self.file, &self.index, numcols,
+                    colnums, chunk_points, arraytype, &result)
+        free(colnums)
+        if self.reader == NULL:
+            if result == kAG_MemoryErr:
+                raise MemoryError()
             raise IOError((result,
-                'AG_GetNumberOfColumns returned error %d' % result))
-        elif numcolumns < 0:
-            raise IOError('number of columns was negative')
+                'AG_OpenChunkReader returned error %d' % result))
+
+    def __dealloc__(self):
+        self.release()
+
+    def close(self):
+        """Close the file; no more chunks can be read"""
+        self.release()
+
+    cdef release(self):
+        if self.reader != NULL:
+            AG_CloseChunkReader(self.reader)
+            self.reader = NULL
+        if self.indexed:
+            AG_FreeColumnIndex(&self.index)
+            self.indexed = False
+        if self.file != NULL:
+            with nogil:
+                CloseFile(self.file)
+            self.file = NULL
 
-        # read in each column of data
-        colnames = []
-        coldata = []
-        for colnum in range(numcolumns):
-            result = AG_ReadColumn(file, fileformat, colnum, &columndata)
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        cdef int result
+        cdef int32_t start
+        cdef int32_t c
+
+        if self.reader == NULL:
+            raise StopIteration
+        with nogil:
+            result = AG_ReadChunk(self.reader, &start)
+        if result == 1:
+            self.close()
+            raise StopIteration
+        elif result != 0:
+            self.close()
+            raise IOError((result, 'AG_ReadChunk returned error %d' % result))
+
+        data = [copy_columndata(AG_ChunkColumn(self.reader, c))
+                for c in range(len(self.names))]
+        return file_chunk(list(self.names), data, self.index.fileFormat,
+                start)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+
+def read_chunks(char* filename, columns = None, chunk_points = 1 << 16,
+        dtype = None):
+    """Read the columns of an Axograph file a chunk at a time
+
+    Returns an iterator over axographio.file_chunk objects, each holding
+    the next chunk_points samples of every selected column, so that files
+    too large to fit in memory can be processed in one pass. columns
+    selects the columns as in read(), and dtype (None, np.float32 or
+    np.float64) converts them as in read(); chunks of linear sequences
+    are computed, not read.
+
+    Each column is read through a single buffer of chunk_points samples,
+    seeking to each chunk in turn, and byte swapped or converted there
+    without holding the global interpreter lock, so memory use depends
+    only on chunk_points and the number of columns, not on the length of
+    the file. The samples are copied out of the buffer into the arrays of
+    each chunk, which stay valid after the next chunk is read.
+
+    The file stays open until the last chunk has been read, or until the
+    iterator's close method is called; it can also be used as a context
+    manager.
+
+    """
+    cdef int arraytype = 0
+
+    if chunk_points < 1:
+        raise ValueError('chunk_points must be at least 1')
+    if dtype is not None:
+        dtype = np.dtype(dtype)
+        if dtype == np.float32:
+            arraytype = FloatArrayType
+        elif dtype == np.float64:
+            arraytype = DoubleArrayType
+        else:
+            raise ValueError('dtype must be np.float32 or np.float64')
+
+    return _chunkreader(filename, columns, chunk_points, arraytype)
+
+
+
+def read_envelope(char* filename, column, int bins):
+    """Read the min/max envelope of one column of an Axograph file
+
+    The column, selected by index or by name as in read(), is split into
+    bins runs of consecutive samples, as equal in length as possible, and
+    the lowest and highest value in each is found, which is all that is
+    needed to draw it at one bin per pixel. Returns an
+    axographio.column_envelope. A column with fewer samples than bins gets
+    one bin per sample.
+
+    The samples are read, byte swapped and scanned a small block at a time,
+    without holding the global interpreter lock, so memory use does not
+    depend on the length of the column and the column itself is never
+    stored. The time of each bin is read from the file's first column, one
+    sample per bin (linear sequences are computed, not read), and is NaN
+    for a bin that starts past the end of the first column. The file is
+    opened for positioned reads, so each of these is a single read at its
+    offset, with no seek and no stdio buffer to refill.
+
+    """
+    cdef int result
+    cdef ColumnIndex index
+    cdef AGDataRef file
+    cdef np.ndarray minima, maxima, time, starts
+    cdef int64_t* startdata
+    cdef double* minimadata
+    cdef double* maximadata
+    cdef double* timedata
+    cdef ColumnData* timecolumn
+    cdef int colnum
+    cdef int32_t points, timebins, b
+
+    if bins < 1:
+        raise ValueError('bins must be at least 1')
+
+    # open the file
+    with nogil:
+        file = OpenPositionedFile(filename)
+    if file == NULL:
+        raise IOError('file not found')
+
+    try:
+        with nogil:
+            result = AG_BuildColumnIndex(file, &index)
+        try:
+            if result != 0:
+                raise _index_error(result)
+            selected = _select_columns(index_columns(&index), column)
+            if len(selected) != 1:
+                raise ValueError('column must select exactly one column')
+            colnum = selected[0]
+            points = index.columns[colnum].column.points
+            if bins > points:
+                bins = points
+
+            minima = np.empty(bins, dtype = np.float64)
+            maxima = np.empty(bins, dtype = np.float64)
+            starts = np.arange(bins, dtype = np.int64) * points // bins
+            startdata = <int64_t*>starts.data
+            minimadata = <double*>minima.data
+            maximadata = <double*>maxima.data
+            with nogil:
+                result = AG_ReadColumnEnvelope(file, &index, colnum, bins,
+                        minimadata, maximadata)
             if result != 0:
                 raise IOError((result,
-                    'AG_ReadColumn returned error %d' % result))
-
-            if <char*>columndata.title is None:
-                colname = '' #'Column %d' % colnum
+                    'AG_ReadColumnEnvelope returned error %d' % result))
+
+            # only the bins that start within the time column have a time
+            timecolumn = &index.columns[0].column
+            timebins = np.searchsorted(starts, timecolumn.points)
+            time = np.full(bins, np.nan)
+            timedata = <double*>time.data
+            if timecolumn.type == SeriesArrayType:
+                time[:timebins] = (timecolumn.seriesArray.firstValue
+                        + starts[:timebins] * timecolumn.seriesArray.increment)
             else:
-                colname = <char*>(columndata.title)
-            colnames += [colname]
-            coldata += [convert_columndata(&columndata)]
-            free_columndata(&columndata)
+                with nogil:
+                    b = 0
+                    while result == 0 and b < timebins:
+                        result = AG_ReadColumnAsDouble(file, &index, 0,
+                                startdata[b], startdata[b] + 1, &timedata[b])
+                        b += 1
+                if result != 0:
+                    raise IOError((result,
+                        'AG_ReadColumnAsDouble returned error %d' % result))
+
+            name = column_title(&index.columns[colnum].column)
+        finally:
+            AG_FreeColumnIndex(&index)
+
+    finally:
+        with nogil:
+            CloseFile(file)
+
+    return column_envelope(name, time, minima, maxima, points)
+
+
+
+def _batch_error(result, filename):
+    """Create the exception for an error reading one file in read_many"""
+    if result == kAG_FileNotFoundErr:
+        return IOError('file not found: %r' % filename)
+    elif result == kAG_ColumnErr:
+        return KeyError('selected columns are not all in %r' % filename)
+    elif result == kAG_FormatErr or result == kAG_VersionErr:
+        return IOError('file is not in AxoGraph format, or is damaged: %r'
+                % filename)
+    else:
+        return IOError((result,
+            'error %d reading %r' % (result, filename)))
+
+
+
+def read_many(paths, columns = None, workers = None, use_ring = False):
+    """Read many Axograph files at once
+
+    Read each of the files in paths and return a list of
+    axographio.file_contents objects, in the same order.
+
+    The files are opened, indexed and read on a pool of native threads,
+    without holding the global interpreter lock, so that reading many small
+    files is not limited by the time spent waiting for each one. workers
+    is the number of threads to use; by default, one per processor.
+
+    If columns is given, only those columns are read from each file. As in
+    read(), columns can be a column index, a name, or a list mixing the two,
+    but not a function. Every file must have all of the selected columns.
+
+    Files of up to 4 MB are read whole, a batch at a time, with pread. If
+    use_ring is true they are instead read through io_uring on Linux (when
+    the kernel supports it), which makes far fewer system calls but, with
+    the files already in the page cache, has measured slower.
+
+    If any file cannot be read, the error for the first one in paths is
+    raised once all of the files have been read.
+
+    """
+    cdef AGBatchFile* files
+    cdef AGColumnSelection selection
+    cdef AGColumnSelection* selected = NULL
+    cdef char** selectednames = NULL
+    cdef int32_t* selectednumbers = NULL
+    cdef int32_t numfiles
+    cdef int threads = workers or 0
+    cdef bint ring = use_ring
+    cdef int32_t i, j
+
+    paths = list(paths)
+    filenames = [path if isinstance(path, bytes) else path.encode('ascii')
+            for path in paths]
+    numfiles = len(filenames)
+
+    # sort the selected columns into numbers and names
+    if callable(columns):
+        raise TypeError('read_many does not support selecting columns '
+                'with a function')
+    elif columns is not None:
+        if isinstance(columns, _string_types) or np.ndim(columns) == 0:
+            columns = [columns]
+        names = [name if isinstance(name, bytes) else name.encode('ascii')
+                for name in columns if isinstance(name, _string_types)]
+        numbers = [int(number) for number in columns
+                if not isinstance(number, _string_types)]
+        selection.numberOfNames = len(names)
+        selection.numberOfColumnNumbers = len(numbers)
+        selected = &selection
+
+    files = <AGBatchFile*>malloc((numfiles + 1) * sizeof(AGBatchFile))
+    if files == NULL:
+        raise MemoryError()
+    try:
+        # the selection's arrays are const, so fill them in before handing
+        # them over
+        if selected != NULL:
+            selectednames = <char**>malloc((len(names) + 1) * sizeof(char*))
+            selectednumbers = <int32_t*>malloc(
+                    (len(numbers) + 1) * sizeof(int32_t))
+            if selectednames == NULL or selectednumbers == NULL:
+                raise MemoryError()
+            for j in range(len(names)):
+                name = names[j]
+                selectednames[j] = name
+            for j in range(len(numbers)):
+                selectednumbers[j] = numbers[j]
+            selection.names = selectednames
+            selection.columnNumbers = selectednumbers
+
+        for i in range(numfiles):
+            filename = filenames[i]
+            files[i].fileName = filename
+
+        with nogil:
+            AG_ReadFiles(files, numfiles, selected, threads, ring)
+
+        try:
+            contents = []
+            for i in range(numfiles):
+                if files[i].result != 0:
+                    raise _batch_error(files[i].result, paths[i])
+                colnames = []
+                coldata = []
+                for j in range(files[i].numberOfColumns):
+                    colnames += [column_title(&files[i].columns[j])]
+                    coldata += [take_columndata(&files[i].columns[j])]
+                contents += [file_contents(colnames, coldata,
+                    files[i].fileFormat)]
+        finally:
+            for i in range(numfiles):
+                AG_FreeBatchFile(&files[i])
+
+    finally:
+        free(selectednames)
+        free(selectednumbers)
+        free(files)
+
+    return contents
+
+
+
+def _scan_many(filenames, workers = None):
+    """Read the column headers and trailers of many Axograph files at once
+
+    filenames is a list of file names, as bytes. Each file is indexed and
+    its trailer read on a pool of native threads, as in read_many, without
+    reading any samples. Returns a list with, for each file, a tuple of
+    its file_header and file_trailer objects, None if it could not be
+    opened, False if it is not an Axograph file (or is of a version this
+    module cannot read), or otherwise the exception that reading it would
+    raise (which is returned rather than raised, so that one bad file does
+    not stop the rest being scanned).
+
+    """
+    cdef AGScannedFile* files
+    cdef int32_t numfiles = len(filenames)
+    cdef int threads = workers or 0
+    cdef int32_t i
+
+    files = <AGScannedFile*>malloc((numfiles + 1) * sizeof(AGScannedFile))
+    if files == NULL:
+        raise MemoryError()
+    try:
+        for i in range(numfiles):
+            filename = filenames[i]
+            files[i].fileName = filename
+
+        with nogil:
+            AG_ScanFiles(files, numfiles, threads)
+
+        try:
+            scanned = []
+            for i in range(numfiles):
+                if files[i].result == kAG_FileNotFoundErr:
+                    scanned += [None]
+                    continue
+                elif (files[i].result == kAG_FormatErr
+                        or files[i].result == kAG_VersionErr):
+                    scanned += [False]
+                    continue
+                elif files[i].result != 0:
+                    scanned += [_batch_error(files[i].result, filenames[i])]
+                    continue
+                try:
+                    columns = index_columns(&files[i].columnIndex)
+                except UnicodeDecodeError as error:
+                    scanned += [error]
+                    continue
+                header = file_header([c.name for c in columns], columns,
+                        files[i].columnIndex.fileFormat)
+                scanned += [(header, trailer_contents(&files[i].trailer))]
+        finally:
+            for i in range(numfiles):
+                AG_FreeScannedFile(&files[i])
 
     finally:
-        CloseFile(file)
+        free(files)
 
-    return file_contents(colnames, coldata, fileformat)
+    return scanned
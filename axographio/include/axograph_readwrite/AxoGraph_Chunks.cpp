@@ -0,0 +1,227 @@
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Chunks : read columns of an AxoGraph file a fixed number of samples
+	at a time, in constant memory.
+
+	See also : AxoGraph_Chunks.h
+
+---------------------------------------------------------------------------------- */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "AxoGraph_Chunks.h"
+
+
+struct AGChunkReader {
+	AGDataRef refNum;
+	const ColumnIndex *columnIndex;
+	int32_t numberOfColumns;
+	int32_t chunkPoints;
+	int arrayType;
+	int64_t nextStart;		// first sample of the next chunk
+	int32_t longest;		// points in the longest column
+
+	// For each column, its number in the index, its buffer ( NULL for series
+	// read in their own type ), and the chunk most recently read into it
+	int32_t *columnNumbers;
+	void **buffers;
+	ColumnData *chunks;
+};
+
+
+static int64_t ChunkElementBytes( const int type )
+{
+	switch ( type )
+	{
+		case ShortArrayType:
+		case ScaledShortArrayType:
+			return sizeof( short );
+		case IntArrayType:
+			return sizeof( int32_t );
+		case FloatArrayType:
+			return sizeof( float );
+		case DoubleArrayType:
+			return sizeof( double );
+		default:
+			return 0;
+	}
+}
+
+
+static void SetChunkArray( ColumnData *chunk, void *buffer )
+{
+	switch ( chunk->type )
+	{
+		case ShortArrayType:
+			chunk->shortArray = ( short * )buffer;
+			break;
+		case ScaledShortArrayType:
+			chunk->scaledShortArray.shortArray = ( short * )buffer;
+			break;
+		case IntArrayType:
+			chunk->intArray = ( int * )buffer;
+			break;
+		case FloatArrayType:
+			chunk->floatArray = ( float * )buffer;
+			break;
+		case DoubleArrayType:
+			chunk->doubleArray = ( double * )buffer;
+			break;
+		default:
+			break;
+	}
+}
+
+
+AGChunkReader *AG_OpenChunkReader( const AGDataRef refNum, const ColumnIndex *columnIndex,
+								   const int32_t numberOfColumns, const int32_t *columnNumbers,
+								   const int32_t chunkPoints, const int arrayType, int *result )
+{
+	*result = 0;
+	if ( numberOfColumns < 0 || chunkPoints <= 0 ||
+		 ( arrayType != 0 && arrayType != FloatArrayType && arrayType != DoubleArrayType ) )
+	{
+		*result = -1;
+		return NULL;
+	}
+
+	AGChunkReader *reader = ( AGChunkReader * )calloc( 1, sizeof( AGChunkReader ) );
+	if ( reader == NULL )
+	{
+		*result = kAG_MemoryErr;
+		return NULL;
+	}
+	reader->refNum = refNum;
+	reader->columnIndex = columnIndex;
+	reader->chunkPoints = chunkPoints;
+	reader->arrayType = arrayType;
+	reader->columnNumbers = ( int32_t * )calloc( numberOfColumns + 1, sizeof( int32_t ) );
+	reader->buffers = ( void ** )calloc( numberOfColumns + 1, sizeof( void * ) );
+	reader->chunks = ( ColumnData * )calloc( numberOfColumns + 1, sizeof( ColumnData ) );
+	if ( reader->columnNumbers == NULL || reader->buffers == NULL || reader->chunks == NULL )
+	{
+		AG_CloseChunkReader( reader );
+		*result = kAG_MemoryErr;
+		return NULL;
+	}
+
+	// Set up each column, counting it first so that AG_CloseChunkReader frees
+	// whatever has been allocated if anything fails
+	for ( int32_t c=0; c<numberOfColumns; c++ )
+	{
+		reader->numberOfColumns++;
+		int32_t columnNumber = columnNumbers[c];
+		if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		{
+			*result = -1;
+			break;
+		}
+		reader->columnNumbers[c] = columnNumber;
+
+		const ColumnData *columnData = &columnIndex->columns[columnNumber].column;
+		if ( columnData->points > reader->longest )
+			reader->longest = columnData->points;
+
+		ColumnData *chunk = &reader->chunks[c];
+		*chunk = *columnData;
+		chunk->title = NULL;
+		chunk->points = 0;
+		if ( arrayType != 0 )
+			chunk->type = ( ColumnType )arrayType;
+		if ( chunk->type == SeriesArrayType )
+			continue;
+
+		int64_t elementBytes = ChunkElementBytes( chunk->type );
+		if ( elementBytes == 0 )
+		{
+			*result = kAG_FormatErr;
+			break;
+		}
+		reader->buffers[c] = malloc( ( size_t )( chunkPoints * elementBytes ) );
+		if ( reader->buffers[c] == NULL )
+		{
+			*result = kAG_MemoryErr;
+			break;
+		}
+		SetChunkArray( chunk, reader->buffers[c] );
+	}
+
+	if ( *result )
+	{
+		AG_CloseChunkReader( reader );
+		return NULL;
+	}
+	return reader;
+}
+
+
+int AG_ReadChunk( AGChunkReader *reader, int32_t *start )
+{
+	*start = ( int32_t )reader->nextStart;
+	if ( reader->nextStart >= reader->longest )
+		return 1;
+
+	const ColumnIndex *columnIndex = reader->columnIndex;
+	int32_t first = ( int32_t )reader->nextStart;
+	for ( int32_t c=0; c<reader->numberOfColumns; c++ )
+	{
+		int32_t columnNumber = reader->columnNumbers[c];
+		const ColumnData *columnData = &columnIndex->columns[columnNumber].column;
+		ColumnData *chunk = &reader->chunks[c];
+
+		// Clip the chunk to the column
+		int64_t stop = reader->nextStart + reader->chunkPoints;
+		if ( stop > columnData->points )
+			stop = columnData->points;
+		chunk->points = stop > first ? ( int32_t )( stop - first ) : 0;
+		if ( chunk->points == 0 )
+			continue;
+
+		int result = 0;
+		switch ( reader->arrayType )
+		{
+			case FloatArrayType:
+				result = AG_ReadColumnAsFloat( reader->refNum, columnIndex, columnNumber, first,
+											   ( int32_t )stop, chunk->floatArray );
+				break;
+			case DoubleArrayType:
+				result = AG_ReadColumnAsDouble( reader->refNum, columnIndex, columnNumber, first,
+												( int32_t )stop, chunk->doubleArray );
+				break;
+			default:
+				if ( chunk->type == SeriesArrayType )
+					chunk->seriesArray.firstValue = columnData->seriesArray.firstValue +
+													first * columnData->seriesArray.increment;
+				else
+					result = AG_ReadColumnRangeInto( reader->refNum, columnIndex, columnNumber, first,
+													 ( int32_t )stop, reader->buffers[c] );
+				break;
+		}
+		if ( result )
+			return result;
+	}
+
+	reader->nextStart += reader->chunkPoints;
+	return 0;
+}
+
+
+const ColumnData *AG_ChunkColumn( const AGChunkReader *reader, const int32_t column )
+{
+	if ( column < 0 || column >= reader->numberOfColumns )
+		return NULL;
+	return &reader->chunks[column];
+}
+
+
+void AG_CloseChunkReader( AGChunkReader *reader )
+{
+	if ( reader->buffers != NULL )
+		for ( int32_t c=0; c<reader->numberOfColumns; c++ )
+			free( reader->buffers[c] );
+	free( reader->buffers );
+	free( reader->columnNumbers );
+	free( reader->chunks );
+	free( reader );
+}
@@ -0,0 +1,65 @@
+#ifndef AXOGRAPH_CHUNKS_H
+#define AXOGRAPH_CHUNKS_H
+
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Chunks : read columns of an AxoGraph file a fixed number of samples
+	at a time, in constant memory.
+
+	See also : AxoGraph_ReadWrite.h, AxoGraph_Stream.h
+
+	AG_ReadColumn reads a whole column into memory. A chunk reader instead
+	steps through a set of columns listed in a column index together, chunkPoints
+	samples at a time: each chunk holds samples start <= i < start + chunkPoints
+	of every column. Each column has a single buffer of chunkPoints samples,
+	allocated when the reader is opened, which every chunk is read into ( seeking
+	to the chunk with the column index ) and byte swapped or converted in. The
+	samples of a chunk are therefore only valid until the next one is read.
+
+	Columns may have different numbers of points; a column that has run out
+	has no samples in the remaining chunks, which go on until the longest
+	column is finished.
+
+---------------------------------------------------------------------------------- */
+
+#include "fileUtils.h"
+#include "AxoGraph_ReadWrite.h"
+
+
+// An open chunk reader; its contents are private to AxoGraph_Chunks.cpp
+struct AGChunkReader;
+
+
+AGChunkReader *AG_OpenChunkReader( const AGDataRef refNum, const ColumnIndex *columnIndex,
+								   const int32_t numberOfColumns, const int32_t *columnNumbers,
+								   const int32_t chunkPoints, const int arrayType, int *result );
+
+//	Set up a reader for the given columns of a file and its column index, both
+//	of which must outlive the reader. If arrayType is 0, chunks are read in
+//	each column's own type, in native byte order ( scaled short columns keep
+//	their scale and offset, and series columns are not read at all ). If it is
+//	FloatArrayType or DoubleArrayType, every column is converted to that type
+//	as by AG_ReadColumnAsFloat or AG_ReadColumnAsDouble. Returns NULL, with
+//	the error in result, if a column number is out of range or the buffers
+//	could not be allocated.
+
+int AG_ReadChunk( AGChunkReader *reader, int32_t *start );
+
+//	Read the next chunk of every column, and set start to the number of its
+//	first sample. Returns 0 if all goes well, 1 with no chunk read once every
+//	column has been read, or the error code if one occurs.
+//	The file position is not preserved between chunks, so other reads may be
+//	made from the same file in between.
+
+const ColumnData *AG_ChunkColumn( const AGChunkReader *reader, const int32_t column );
+
+//	The chunk just read of the reader's column'th column ( numbered in the
+//	order given to AG_OpenChunkReader ), with its type, its number of points
+//	in this chunk, and its array in the reader's buffer ( or, for a series,
+//	the value of its first sample ). The title is not set.
+
+void AG_CloseChunkReader( AGChunkReader *reader );
+
+//	Free the reader and its buffers. The file and column index are left open.
+
+#endif
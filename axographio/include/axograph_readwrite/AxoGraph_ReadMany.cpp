@@ -0,0 +1,439 @@
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_ReadMany : read many AxoGraph data files at once on a pool of threads.
+
+	See also : AxoGraph_ReadMany.h
+
+---------------------------------------------------------------------------------- */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "AxoGraph_ReadMany.h"
+
+
+// A task run by RunOnPool for one index
+typedef void ( *PoolTask )( void *context, int64_t index );
+
+struct PoolQueue {
+	PoolTask task;
+	void *context;
+	int64_t count;
+	std::atomic<int64_t> next;
+};
+
+static void RunQueuedTasks( PoolQueue *queue )
+{
+	for ( ;; )
+	{
+		int64_t i = queue->next++;
+		if ( i >= queue->count )
+			return;
+		queue->task( queue->context, i );
+	}
+}
+
+// Run task for every index 0 <= i < count, using up to the given number of
+// threads ( or one per processor if threads <= 0 ), each taking the next
+// index in turn as it becomes free. The calling thread runs tasks too, and if
+// fewer threads can be started the tasks are shared out among those.
+static void RunOnPool( PoolTask task, void *context, const int64_t count, int threads )
+{
+	if ( threads <= 0 )
+		threads = std::thread::hardware_concurrency();
+	if ( threads > count )
+		threads = ( int )count;
+
+	PoolQueue queue;
+	queue.task = task;
+	queue.context = context;
+	queue.count = count;
+	queue.next = 0;
+
+	// The calling thread runs tasks too, so start one thread fewer
+	std::vector<std::thread> pool;
+	for ( int t=1; t<threads; t++ )
+	{
+		try
+		{
+			pool.push_back( std::thread( RunQueuedTasks, &queue ) );
+		}
+		catch ( const std::system_error & )
+		{
+			break;
+		}
+	}
+
+	RunQueuedTasks( &queue );
+	for ( size_t t=0; t<pool.size(); t++ )
+		pool[t].join();
+}
+
+
+// Free the title and sample array of a column read by AG_ReadColumn
+static void FreeColumnData( ColumnData *columnData )
+{
+	free( columnData->title );
+	columnData->title = NULL;
+
+	switch ( columnData->type )
+	{
+		case ShortArrayType:
+			free( columnData->shortArray );
+			columnData->shortArray = NULL;
+			break;
+		case IntArrayType:
+			free( columnData->intArray );
+			columnData->intArray = NULL;
+			break;
+		case FloatArrayType:
+			free( columnData->floatArray );
+			columnData->floatArray = NULL;
+			break;
+		case DoubleArrayType:
+			free( columnData->doubleArray );
+			columnData->doubleArray = NULL;
+			break;
+		case ScaledShortArrayType:
+			free( columnData->scaledShortArray.shortArray );
+			columnData->scaledShortArray.shortArray = NULL;
+			break;
+		default:
+			break;
+	}
+}
+
+
+// Mark the columns of an indexed file that are chosen by selection
+static int SelectColumns( const ColumnIndex *columnIndex, const AGColumnSelection *selection, bool *selected )
+{
+	int32_t numberOfColumns = columnIndex->numberOfColumns;
+
+	if ( selection == NULL )
+	{
+		for ( int32_t c=0; c<numberOfColumns; c++ )
+			selected[c] = true;
+		return 0;
+	}
+
+	for ( int32_t i=0; i<selection->numberOfColumnNumbers; i++ )
+	{
+		int32_t c = selection->columnNumbers[i];
+		if ( c < 0 )
+			c += numberOfColumns;
+		if ( c < 0 || c >= numberOfColumns )
+			return kAG_ColumnErr;
+		selected[c] = true;
+	}
+
+	for ( int32_t i=0; i<selection->numberOfNames; i++ )
+	{
+		bool found = false;
+		for ( int32_t c=0; c<numberOfColumns; c++ )
+		{
+			const char *title = ( const char * )columnIndex->columns[c].column.title;
+			if ( title != NULL && strcmp( title, selection->names[i] ) == 0 )
+			{
+				selected[c] = true;
+				found = true;
+			}
+		}
+		if ( !found )
+			return kAG_ColumnErr;
+	}
+
+	return 0;
+}
+
+
+// Read the selected columns of a single file into its entry, from its copy
+// in memory if it has one, or else by opening it
+static int ReadBatchFile( AGBatchFile *file, AGDataRef wholeFile, const AGColumnSelection *selection )
+{
+	AGDataRef refNum = wholeFile ? wholeFile : OpenFile( file->fileName );
+	if ( !refNum )
+		return kAG_FileNotFoundErr;
+
+	ColumnIndex columnIndex;
+	int result = AG_BuildColumnIndex( refNum, &columnIndex );
+	file->fileFormat = columnIndex.fileFormat;
+
+	bool *selected = NULL;
+	if ( result == 0 )
+	{
+		selected = ( bool * )calloc( columnIndex.numberOfColumns + 1, sizeof( bool ) );
+		file->columns = ( ColumnData * )calloc( columnIndex.numberOfColumns + 1, sizeof( ColumnData ) );
+		if ( selected == NULL || file->columns == NULL )
+			result = kAG_MemoryErr;
+	}
+	if ( result == 0 )
+		result = SelectColumns( &columnIndex, selection, selected );
+
+	// Read each selected column, counting it first so that anything
+	// allocated by a failed read is still freed by AG_FreeBatchFile
+	for ( int32_t c=0; result == 0 && c<columnIndex.numberOfColumns; c++ )
+	{
+		if ( !selected[c] )
+			continue;
+
+		ColumnData *columnData = &file->columns[file->numberOfColumns++];
+		result = AG_SeekColumn( refNum, &columnIndex, c );
+		if ( result == 0 )
+			result = AG_ReadColumn( refNum, columnIndex.fileFormat, c, columnData );
+	}
+
+	free( selected );
+	AG_FreeColumnIndex( &columnIndex );
+	CloseFile( refNum );
+	return result;
+}
+
+
+// The files to be read by AG_ReadFiles, in batches of batch files
+struct BatchList {
+	AGBatchFile *files;
+	int32_t numberOfFiles;
+	const AGColumnSelection *selection;
+	int32_t batch;
+	bool useRing;
+};
+
+// Read all those files of a batch no larger than kAG_WholeFileBytes into
+// memory together, and parse them there
+static void ReadBatch( void *context, int64_t index )
+{
+	const BatchList *list = ( const BatchList * )context;
+	const char *fileNames[kAG_WholeFileBatch];
+	AGDataRef wholeFiles[kAG_WholeFileBatch];
+
+	int32_t first = ( int32_t )index * list->batch;
+	int32_t count = list->numberOfFiles - first;
+	if ( count > list->batch )
+		count = list->batch;
+	if ( count <= 0 )
+		return;
+
+	for ( int32_t i=0; i<count; i++ )
+		fileNames[i] = list->files[first + i].fileName;
+	ReadWholeFiles( fileNames, count, kAG_WholeFileBytes, list->useRing, wholeFiles );
+
+	for ( int32_t i=0; i<count; i++ )
+	{
+		AGBatchFile *file = &list->files[first + i];
+		file->result = ReadBatchFile( file, wholeFiles[i], list->selection );
+	}
+}
+
+
+void AG_ReadFiles( AGBatchFile *files, const int32_t numberOfFiles,
+				   const AGColumnSelection *selection, int threads, const bool useRing )
+{
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+	{
+		files[i].result = 0;
+		files[i].fileFormat = 0;
+		files[i].numberOfColumns = 0;
+		files[i].columns = NULL;
+	}
+	if ( numberOfFiles <= 0 )
+		return;
+
+	if ( threads <= 0 )
+		threads = std::thread::hardware_concurrency();
+	if ( threads <= 0 || threads > numberOfFiles )
+		threads = numberOfFiles;
+
+	BatchList list;
+	list.files = files;
+	list.numberOfFiles = numberOfFiles;
+	list.selection = selection;
+	list.useRing = useRing;
+
+	// Smaller batches when there are too few files to give every thread
+	// kAG_WholeFileBatch of them
+	list.batch = ( numberOfFiles + threads - 1 ) / threads;
+	if ( list.batch > kAG_WholeFileBatch )
+		list.batch = kAG_WholeFileBatch;
+
+	int32_t batches = ( numberOfFiles + list.batch - 1 ) / list.batch;
+	RunOnPool( ReadBatch, &list, batches, threads );
+}
+
+
+void AG_FreeBatchFile( AGBatchFile *file )
+{
+	for ( int32_t c=0; c<file->numberOfColumns; c++ )
+		FreeColumnData( &file->columns[c] );
+
+	free( file->columns );
+	file->columns = NULL;
+	file->numberOfColumns = 0;
+}
+
+
+// Index a single file and read its trailer into its entry
+static int ScanFile( AGScannedFile *file )
+{
+	AGDataRef refNum = OpenFile( file->fileName );
+	if ( !refNum )
+		return kAG_FileNotFoundErr;
+
+	int result = AG_BuildColumnIndex( refNum, &file->columnIndex );
+	if ( result == 0 )
+		result = AG_ReadTrailer( refNum, &file->columnIndex, &file->trailer );
+
+	CloseFile( refNum );
+	return result;
+}
+
+
+static void ScanListedFile( void *context, int64_t index )
+{
+	AGScannedFile *file = &( ( AGScannedFile * )context )[index];
+	file->result = ScanFile( file );
+}
+
+
+void AG_ScanFiles( AGScannedFile *files, const int32_t numberOfFiles, int threads )
+{
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+	{
+		files[i].result = 0;
+		memset( &files[i].columnIndex, 0, sizeof( ColumnIndex ) );
+		memset( &files[i].trailer, 0, sizeof( AGTrailer ) );
+	}
+
+	RunOnPool( ScanListedFile, files, numberOfFiles, threads );
+}
+
+
+void AG_FreeScannedFile( AGScannedFile *file )
+{
+	AG_FreeColumnIndex( &file->columnIndex );
+	AG_FreeTrailer( &file->trailer );
+}
+
+
+// Size in bytes of one sample of an array of the given type
+static int64_t ReadElementBytes( const int type )
+{
+	switch ( type )
+	{
+		case ShortArrayType:
+		case ScaledShortArrayType:
+			return sizeof( short );
+		case IntArrayType:
+			return sizeof( int32_t );
+		case FloatArrayType:
+			return sizeof( float );
+		case DoubleArrayType:
+			return sizeof( double );
+		default:
+			return 0;
+	}
+}
+
+
+// Samples start <= i < stop of one of the reads given to AG_ReadColumnsParallel
+struct ReadPiece {
+	int32_t read;
+	int32_t start;
+	int32_t stop;
+	int result;
+};
+
+// The pieces to be read by AG_ReadColumnsParallel
+struct PieceList {
+	AGDataRef refNum;
+	const ColumnIndex *columnIndex;
+	const AGColumnRead *reads;
+	int arrayType;
+	std::vector<ReadPiece> pieces;
+};
+
+static int ReadPieceInto( const PieceList *list, const ReadPiece *piece )
+{
+	const AGColumnRead *read = &list->reads[piece->read];
+	int type = list->arrayType != 0 ? list->arrayType : 
+			   list->columnIndex->columns[read->columnNumber].column.type;
+	unsigned char *array = ( unsigned char * )read->array + ( piece->start - read->start ) * ReadElementBytes( type );
+
+	switch ( list->arrayType )
+	{
+		case FloatArrayType:
+			return AG_ReadColumnAsFloat( list->refNum, list->columnIndex, read->columnNumber, 
+										 piece->start, piece->stop, ( float * )array );
+		case DoubleArrayType:
+			return AG_ReadColumnAsDouble( list->refNum, list->columnIndex, read->columnNumber, 
+										  piece->start, piece->stop, ( double * )array );
+		default:
+			return AG_ReadColumnRangeInto( list->refNum, list->columnIndex, read->columnNumber, 
+										   piece->start, piece->stop, array );
+	}
+}
+
+static void ReadListedPiece( void *context, int64_t index )
+{
+	PieceList *list = ( PieceList * )context;
+	list->pieces[index].result = ReadPieceInto( list, &list->pieces[index] );
+}
+
+
+int AG_ReadColumnsParallel( const AGDataRef refNum, const ColumnIndex *columnIndex,
+							const AGColumnRead *reads, const int32_t numberOfReads,
+							const int arrayType, int threads )
+{
+	if ( arrayType != 0 && arrayType != FloatArrayType && arrayType != DoubleArrayType )
+		return -1;
+
+	PieceList list;
+	list.refNum = refNum;
+	list.columnIndex = columnIndex;
+	list.reads = reads;
+	list.arrayType = arrayType;
+
+	// Cut every read into pieces, in order, so the first error found in the
+	// pieces is the first in the reads
+	try
+	{
+		for ( int32_t r=0; r<numberOfReads; r++ )
+		{
+			const AGColumnRead *read = &reads[r];
+			if ( read->columnNumber < 0 || read->columnNumber >= columnIndex->numberOfColumns )
+				return -1;
+			int type = columnIndex->columns[read->columnNumber].column.type;
+			if ( arrayType == 0 && type == SeriesArrayType )
+				continue;
+			if ( ReadElementBytes( arrayType != 0 ? arrayType : type ) == 0 )
+				return kAG_FormatErr;
+
+			for ( int32_t start=read->start; start<read->stop; )
+			{
+				ReadPiece piece;
+				piece.read = r;
+				piece.start = start;
+				piece.stop = read->stop - start > kAG_ParallelPiecePoints ? start + kAG_ParallelPiecePoints : read->stop;
+				piece.result = 0;
+				list.pieces.push_back( piece );
+				start = piece.stop;
+			}
+		}
+	}
+	catch ( const std::bad_alloc & )
+	{
+		return kAG_MemoryErr;
+	}
+
+	RunOnPool( ReadListedPiece, &list, ( int64_t )list.pieces.size(), threads );
+
+	for ( size_t i=0; i<list.pieces.size(); i++ )
+		if ( list.pieces[i].result )
+			return list.pieces[i].result;
+	return 0;
+}
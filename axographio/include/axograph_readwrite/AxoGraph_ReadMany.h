@@ -0,0 +1,141 @@
+#ifndef AXOGRAPH_READMANY_H
+#define AXOGRAPH_READMANY_H
+
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_ReadMany : read many AxoGraph data files, or the columns of one
+	large file, at once on a pool of threads.
+
+	See also : AxoGraph_ReadWrite.h, AxoGraph_Trailer.h
+
+	Each file is opened, indexed and read with the functions in AxoGraph_ReadWrite,
+	so the columns returned are exactly those AG_ReadColumn would return.
+	Reading small files is dominated by the latency of opening and seeking in
+	them, which is hidden by keeping several files in flight at once. Each
+	thread takes up to kAG_WholeFileBatch files at a time and reads the small ones
+	whole with ReadWholeFiles, then parses them in memory; larger files are
+	opened and read as usual. The small files are read with pread unless the
+	caller asks for io_uring, where the opens, reads and closes of a batch cost
+	a couple of system calls in all; with the files in the page cache that has
+	measured slower than pread, as the kernel hands some of the work to its
+	own worker threads.
+
+	A single large file is instead split into pieces of at most
+	kAG_ParallelPiecePoints samples of one column, which the threads take in
+	turn as they become free, so that one very long column is shared out
+	rather than leaving the other threads idle. Each piece is read with a
+	positioned read, and byte swapped or converted straight into the caller's
+	array.
+
+	Many files can also be scanned without reading their samples, for their
+	column headers and trailers alone, as when cataloguing a directory tree.
+
+---------------------------------------------------------------------------------- */
+
+#include "fileUtils.h"
+#include "AxoGraph_ReadWrite.h"
+#include "AxoGraph_Trailer.h"
+
+// error numbers
+const int16_t kAG_ColumnErr = -25;			// a selected column is not in the file
+const int16_t kAG_FileNotFoundErr = -43;	// the file could not be opened
+
+
+// The most files each thread of AG_ReadFiles takes at a time, and the largest
+// of them read whole into memory
+const int32_t kAG_WholeFileBatch = 32;
+const int64_t kAG_WholeFileBytes = 4 << 20;
+
+
+// Which columns to read from every file. A column is read if its number
+// ( counting from the end of the file if negative ) is one of columnNumbers,
+// or its title is one of names. Every listed column must be in the file.
+struct AGColumnSelection {
+	int32_t numberOfColumnNumbers;
+	const int32_t *columnNumbers;
+	int32_t numberOfNames;
+	const char * const *names;
+};
+
+
+// One file to be read by AG_ReadFiles
+struct AGBatchFile {
+	const char *fileName;		// set by the caller; everything else is set by AG_ReadFiles
+	int result;					// 0, or the error that stopped the file being read
+	int fileFormat;
+	int32_t numberOfColumns;	// number of columns read
+	ColumnData *columns;		// the columns read, in file order
+};
+
+
+void AG_ReadFiles( AGBatchFile *files, const int32_t numberOfFiles,
+				   const AGColumnSelection *selection, int threads, const bool useRing );
+
+//	Read the selected columns ( or all columns if selection is NULL ) of
+//	every file, using up to the given number of threads ( or one per processor
+//	if threads <= 0 ). Files are taken from the list in order by whichever
+//	thread is free, in batches of kAG_WholeFileBatch ( or fewer, so that
+//	every thread has files to read ), and each file's result
+//	and columns are stored in its entry. useRing is passed on to ReadWholeFiles.
+//	The column titles and arrays are allocated as by AG_ReadColumn; the caller
+//	owns them and must release each entry with AG_FreeBatchFile, even after
+//	an error. If fewer threads can be started, the files are read on those.
+
+void AG_FreeBatchFile( AGBatchFile *file );
+
+//	Free the columns read into a file entry. Any title or array pointer the
+//	caller has taken over should be set to NULL first.
+
+
+// One file to be scanned by AG_ScanFiles
+struct AGScannedFile {
+	const char *fileName;		// set by the caller; everything else is set by AG_ScanFiles
+	int result;					// 0, or the error that stopped the file being scanned
+	ColumnIndex columnIndex;	// the file's format and column headers
+	AGTrailer trailer;			// its comment, notes and trace headers
+};
+
+
+void AG_ScanFiles( AGScannedFile *files, const int32_t numberOfFiles, int threads );
+
+//	Index every file with AG_BuildColumnIndex and read its trailer with
+//	AG_ReadTrailer, reading only headers and never any samples, using up to
+//	the given number of threads ( or one per processor if threads <= 0 ).
+//	Files are taken from the list in order by whichever thread is free. A file
+//	that is not in AxoGraph format gets kAG_FormatErr ( or kAG_VersionErr ),
+//	and one that cannot be opened kAG_FileNotFoundErr. Each entry must be
+//	released with AG_FreeScannedFile, even after an error.
+
+void AG_FreeScannedFile( AGScannedFile *file );
+
+//	Free the column index and trailer read into a file entry.
+
+
+// Samples in each piece that AG_ReadColumnsParallel hands to a thread
+const int32_t kAG_ParallelPiecePoints = 1 << 20;
+
+// One column ( or part of one ) to be read by AG_ReadColumnsParallel
+struct AGColumnRead {
+	int32_t columnNumber;		// in the column index
+	int32_t start;				// samples start <= i < stop are read
+	int32_t stop;
+	void *array;				// room for stop - start samples
+};
+
+
+int AG_ReadColumnsParallel( const AGDataRef refNum, const ColumnIndex *columnIndex,
+							const AGColumnRead *reads, const int32_t numberOfReads,
+							const int arrayType, int threads );
+
+//	Read samples start <= i < stop of each listed column into its array, using
+//	up to the given number of threads ( or one per processor if threads <= 0 ).
+//	If arrayType is 0 the samples are read as AG_ReadColumnRangeInto reads
+//	them, in the column's own type and native byte order ( series columns
+//	read nothing ); if it is FloatArrayType or DoubleArrayType they are
+//	converted as by AG_ReadColumnAsFloat or AG_ReadColumnAsDouble. The ranges
+//	must already be clipped to their columns. The file must have been opened
+//	with OpenPositionedFile or OpenMappedFile, since all the threads read from
+//	it at once. Returns 0 if all goes well, or the error from the first piece
+//	that failed, in the order of reads.
+
+#endif
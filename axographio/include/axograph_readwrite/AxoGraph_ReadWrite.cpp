@@ -10,10 +10,12 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "fileUtils.h"
 #include "stringUtils.h"
 #include "byteswap.h"
+#include "sampleUtils.h"
 
 #include "AxoGraph_ReadWrite.h"
 
@@ -29,7 +31,7 @@ int AG_GetFileFormat( const AGDataRef refNum, int *fileFormat )
 	
 	// Read the 4-byte prefix present in all AxoGraph file formats
 	unsigned char AxoGraphFileID[4];
-	long bytes = 4;	// 4 byte identifier
+	int64_t bytes = 4;	// 4 byte identifier
 	result = ReadFromFile( refNum, &bytes, AxoGraphFileID );
 	if ( result ) 
 		return result;
@@ -98,7 +100,7 @@ int AG_GetNumberOfColumns( const AGDataRef refNum, const int fileFormat, int32_t
 	{
 		// Read the number of columns (short integer in AxoGraph 4 files)
 		short nColumns;
-		long bytes = 2;
+		int64_t bytes = 2;
 		int result = ReadFromFile( refNum, &bytes, &nColumns);
 		if ( result ) 
 			return result;
@@ -114,7 +116,7 @@ int AG_GetNumberOfColumns( const AGDataRef refNum, const int fileFormat, int32_t
 	{
 		// Read the number of columns (int32_t integer in AxoGraph X files) 
 		int32_t nColumns;
-		long bytes = 4;
+		int64_t bytes = 4;
 		int result = ReadFromFile( refNum, &bytes, &nColumns);
 		if ( result ) 
 			return result;
@@ -132,11 +134,17 @@ int AG_GetNumberOfColumns( const AGDataRef refNum, const int fileFormat, int32_t
 
 
 
-int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+// Read a column header, plus any scaling or series parameters that precede the
+// column's sample data. On return the file is positioned at the first sample,
+// columnData is filled in except for the sample array itself, and *dataBytes
+// holds the size of the sample array that follows ( 0 for series columns ).
+static int ReadColumnHeader( const AGDataRef refNum, const int fileFormat, const int columnNumber, 
+							 ColumnData *columnData, int64_t *dataBytes )
 {
 	// Initialize in case of error during read
 	columnData->points = 0;
 	columnData->title = NULL;
+	*dataBytes = 0;
 	
 	switch ( fileFormat ) 
 	{
@@ -144,7 +152,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 		{
 			// Read the standard column header 
 			ColumnHeader columnHeader;		
-			long bytes = sizeof( ColumnHeader );
+			int64_t bytes = sizeof( ColumnHeader );
 			int result = ReadFromFile( refNum, &bytes, &columnHeader );
 			if ( result ) 
 				return result;
@@ -152,6 +160,8 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 #ifdef __LITTLE_ENDIAN__
 			ByteSwapLong( &columnHeader.points );
 #endif
+			if ( columnHeader.points < 0 )
+				return kAG_FormatErr;
 			
 			// Retrieve the title and number of points in the column 
 			columnData->type = FloatArrayType;
@@ -160,19 +170,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 			PascalToCString( columnHeader.title );
 			memcpy( columnData->title, columnHeader.title, 80 );
 			
-			// create a new pointer to receive the data
-			long columnBytes = columnHeader.points * sizeof( float );
-			columnData->floatArray = ( float * )malloc( columnBytes );
-			if ( columnData->floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Read in the column's data 
-			result = ReadFromFile( refNum, &columnBytes, columnData->floatArray );
-
-#ifdef __LITTLE_ENDIAN__
-			ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-			
+			*dataBytes = ( int64_t )columnHeader.points * sizeof( float );
 			return result;
 		}
 			
@@ -182,7 +180,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 			{
 				// Read the column header 
 				DigitizedFirstColumnHeader columnHeader;		
-				long bytes = sizeof( DigitizedFirstColumnHeader );
+				int64_t bytes = sizeof( DigitizedFirstColumnHeader );
 				int result = ReadFromFile( refNum, &bytes, &columnHeader );
 				if ( result ) 
 					return result;
@@ -192,6 +190,8 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 				ByteSwapFloat( &columnHeader.firstPoint );
 				ByteSwapFloat( &columnHeader.sampleInterval );
 #endif
+				if ( columnHeader.points < 0 )
+					return kAG_FormatErr;
 				
 				// Retrieve the title, number of points in the column, and sample interval
 				columnData->type = SeriesArrayType;
@@ -208,7 +208,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 			{
 				// Read the column header 
 				DigitizedColumnHeader columnHeader;		
-				long bytes = sizeof( DigitizedColumnHeader );
+				int64_t bytes = sizeof( DigitizedColumnHeader );
 				int result = ReadFromFile( refNum, &bytes, &columnHeader );
 				if ( result ) 
 					return result;
@@ -217,6 +217,8 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 				ByteSwapLong( &columnHeader.points );
 				ByteSwapFloat( &columnHeader.scalingFactor );
 #endif
+				if ( columnHeader.points < 0 )
+					return kAG_FormatErr;
 				
 				// Retrieve the title and number of points in the column 
 				columnData->type = ScaledShortArrayType;
@@ -228,19 +230,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 				columnData->scaledShortArray.scale = columnHeader.scalingFactor;
 				columnData->scaledShortArray.offset = 0;
 				
-				// create a new pointer to receive the data
-				long columnBytes = columnHeader.points * sizeof( short );
-				columnData->scaledShortArray.shortArray = ( short * )malloc( columnBytes );
-				if ( columnData->scaledShortArray.shortArray == NULL ) 
-					return kAG_MemoryErr;
-				
-				// Read in the column's data 
-				result = ReadFromFile( refNum, &columnBytes, columnData->scaledShortArray.shortArray );
-				
-#ifdef __LITTLE_ENDIAN__
-				ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-				
+				*dataBytes = ( int64_t )columnHeader.points * sizeof( short );
 				return result;
 			}
 		}
@@ -249,7 +239,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 		{
 			// Read the column header 
 			AxoGraphXColumnHeader columnHeader;		
-			long bytes = sizeof( AxoGraphXColumnHeader );
+			int64_t bytes = sizeof( AxoGraphXColumnHeader );
 			int result = ReadFromFile( refNum, &bytes, &columnHeader );
 			if ( result ) 
 				return result;
@@ -264,9 +254,11 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 			columnData->type = (ColumnType)columnHeader.dataType;
 			columnData->points = columnHeader.points;
 			
-			// sanity check on column type
+			// sanity check on column type and length
 			if ( columnData->type < 0 || columnData->type > 14 )
 				return -1;
+			if ( columnHeader.points < 0 )
+				return kAG_FormatErr;
 			
 			// Read the column title 
 			columnData->titleLength = columnHeader.titleLength;
@@ -275,7 +267,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
     			columnData->title = ( unsigned char * )malloc( columnHeader.titleLength );
             else 
     			columnData->title = ( unsigned char * )malloc( 1 );
-			long titleLength = columnHeader.titleLength;
+			int64_t titleLength = columnHeader.titleLength;
             result = ReadFromFile( refNum, &titleLength, columnData->title );
 			if ( result ) 
 				return result;
@@ -286,76 +278,28 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 			{
 				case ShortArrayType:
 				{
-					// create a new pointer to receive the data
-					long columnBytes = columnHeader.points * sizeof( short );
-					columnData->shortArray = ( short * )malloc( columnBytes );
-					if ( columnData->shortArray == NULL ) 
-						return kAG_MemoryErr;
-					
-					// Read in the column's data 
-					result = ReadFromFile( refNum, &columnBytes, columnData->shortArray );
-
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->shortArray, columnHeader.points );
-#endif
-					
+					*dataBytes = ( int64_t )columnHeader.points * sizeof( short );
 					return result;
 				}
 				case IntArrayType:
 				{
-					// create a new pointer to receive the data
-					long columnBytes = columnHeader.points * sizeof( int );
-					columnData->intArray = ( int * )malloc( columnBytes );
-					if ( columnData->intArray == NULL ) 
-						return kAG_MemoryErr;
-					
-					// Read in the column's data 
-					result = ReadFromFile( refNum, &columnBytes, columnData->intArray );
-					
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapLongArray( (int32_t *)columnData->intArray, columnHeader.points );
-#endif
-					
+					*dataBytes = ( int64_t )columnHeader.points * sizeof( int );
 					return result;
 				}
 				case FloatArrayType:
 				{
-					// create a new pointer to receive the data
-					long columnBytes = columnHeader.points * sizeof( float );
-					columnData->floatArray = ( float * )malloc( columnBytes );
-					if ( columnData->floatArray == NULL ) 
-						return kAG_MemoryErr;
-					
-					// Read in the column's data 
-					result = ReadFromFile( refNum, &columnBytes, columnData->floatArray );
-					
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-					
+					*dataBytes = ( int64_t )columnHeader.points * sizeof( float );
 					return result;
 				}
 				case DoubleArrayType:
 				{
-					// create a new pointer to receive the data
-					long columnBytes = columnHeader.points * sizeof( double );
-					columnData->doubleArray = ( double * )malloc( columnBytes );
-					if ( columnData->doubleArray == NULL ) 
-						return kAG_MemoryErr;
-					
-					// Read in the column's data 
-					result = ReadFromFile( refNum, &columnBytes, columnData->doubleArray );
-					
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapDoubleArray( columnData->doubleArray, columnHeader.points );
-#endif
-					
+					*dataBytes = ( int64_t )columnHeader.points * sizeof( double );
 					return result;
 				}
 				case SeriesArrayType:
 				{
 					SeriesArray seriesParameters;
-					long bytes = sizeof( SeriesArray );
+					int64_t bytes = sizeof( SeriesArray );
 					result = ReadFromFile( refNum, &bytes, &seriesParameters );
 					
 #ifdef __LITTLE_ENDIAN__
@@ -370,7 +314,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 				case ScaledShortArrayType:
 				{
 					double scale, offset;
-					long bytes = sizeof( double );
+					int64_t bytes = sizeof( double );
 					result = ReadFromFile( refNum, &bytes, &scale );
 					result = ReadFromFile( refNum, &bytes, &offset );
 					
@@ -382,19 +326,7 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 					columnData->scaledShortArray.scale = scale;
 					columnData->scaledShortArray.offset = offset;
 					
-					// create a new pointer to receive the data
-					long columnBytes = columnHeader.points * sizeof( short );
-					columnData->scaledShortArray.shortArray = ( short * )malloc( columnBytes );
-					if ( columnData->scaledShortArray.shortArray == NULL ) 
-						return kAG_MemoryErr;
-					
-					// Read in the column's data 
-					result = ReadFromFile( refNum, &columnBytes, columnData->scaledShortArray.shortArray );
-					
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-					
+					*dataBytes = ( int64_t )columnHeader.points * sizeof( short );
 					return result;
 				}
 			}
@@ -408,142 +340,747 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 }
 
 
-int AG_ReadFloatColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+// Check that the dataBytes of samples at the current file position lie within
+// the file, before anything is allocated for them. AG_BuildColumnIndex checks
+// every column against the file length it finds once.
+static int CheckColumnInFile( const AGDataRef refNum, const int64_t dataBytes )
+{
+	int64_t posn, length;
+	int result = GetFilePosition( refNum, &posn );
+	if ( result == 0 )
+		result = GetFileLength( refNum, &length );
+	if ( result ) 
+		return result;
+	return dataBytes > length - posn ? kAG_FormatErr : 0;
+}
+
+
+// Store a pointer to the column's sample array in the appropriate union member
+static void SetColumnArray( ColumnData *columnData, void *columnArray )
+{
+	switch ( columnData->type ) 
+	{
+		case ShortArrayType:
+			columnData->shortArray = ( short * )columnArray;
+			break;
+		case IntArrayType:
+			columnData->intArray = ( int * )columnArray;
+			break;
+		case FloatArrayType:
+			columnData->floatArray = ( float * )columnArray;
+			break;
+		case DoubleArrayType:
+			columnData->doubleArray = ( double * )columnArray;
+			break;
+		case ScaledShortArrayType:
+			columnData->scaledShortArray.shortArray = ( short * )columnArray;
+			break;
+		default:
+			break;
+	}
+}
+
+
+// Size in bytes of one sample of a column type, or 0 if the type has no sample array
+static int64_t ColumnElementBytes( const ColumnType type )
+{
+	switch ( type ) 
+	{
+		case ShortArrayType:
+		case ScaledShortArrayType:
+			return sizeof( short );
+		case IntArrayType:
+			return sizeof( int );
+		case FloatArrayType:
+			return sizeof( float );
+		case DoubleArrayType:
+			return sizeof( double );
+		default:
+			return 0;
+	}
+}
+
+
+// Byte swap points samples of the given type, read from a file, if necessary
+static void SwapSamples( const ColumnType type, const int32_t points, void *columnArray )
+{
+#ifdef __LITTLE_ENDIAN__
+	switch ( type ) 
+	{
+		case ShortArrayType:
+		case ScaledShortArrayType:
+			ByteSwapShortArray( ( int16_t * )columnArray, points );
+			break;
+		case IntArrayType:
+			ByteSwapLongArray( ( int32_t * )columnArray, points );
+			break;
+		case FloatArrayType:
+			ByteSwapFloatArray( ( float * )columnArray, points );
+			break;
+		case DoubleArrayType:
+			ByteSwapDoubleArray( ( double * )columnArray, points );
+			break;
+		default:
+			break;
+	}
+#else
+	( void )type;
+	( void )points;
+	( void )columnArray;
+#endif
+}
+
+
+// Read points samples of the given type from the current file position into 
+// columnArray, and byte swap them if necessary.
+static int ReadSamples( const AGDataRef refNum, const ColumnType type, const int32_t points, void *columnArray )
+{
+	// Read in the column's data 
+	int64_t columnBytes = points * ColumnElementBytes( type );
+	int result = ReadFromFile( refNum, &columnBytes, columnArray );
+	SwapSamples( type, points, columnArray );
+	return result;
+}
+
+
+// Read points samples of the given type from file position posn, without
+// using the file position ( see ReadFromFileAt ), and byte swap them.
+static int ReadSamplesAt( const AGDataRef refNum, const int64_t posn, const ColumnType type, const int32_t points, 
+						  void *columnArray )
+{
+	int64_t columnBytes = points * ColumnElementBytes( type );
+	int result = ReadFromFileAt( refNum, posn, &columnBytes, columnArray );
+	SwapSamples( type, points, columnArray );
+	return result;
+}
+
+
+// Allocate the sample array for a column whose header has been read
+static int AllocateColumnArray( ColumnData *columnData, void **columnArray )
 {
-	int result = AG_ReadColumn( refNum, fileFormat, columnNumber, columnData );
+	int64_t columnBytes = columnData->points * ColumnElementBytes( columnData->type );
+	*columnArray = malloc( columnBytes );
+	if ( *columnArray == NULL ) 
+		return kAG_MemoryErr;
+	SetColumnArray( columnData, *columnArray );
+	return 0;
+}
+
+
+// Allocate the sample array for a column whose header has been read, and read
+// columnData->points samples into it from the current file position.
+static int ReadColumnArray( const AGDataRef refNum, ColumnData *columnData )
+{
+	void *columnArray;
+	int result = AllocateColumnArray( columnData, &columnArray );
+	if ( result ) 
+		return result;
 	
-	// If necessary, convert the columnData to FloatArrayType
+	return ReadSamples( refNum, columnData->type, columnData->points, columnArray );
+}
+
+
+// Size of the buffer that ReadConvertedArray reads raw samples into
+static const long kStagingBytes = 64 * 1024;
+
+// Convert count samples, stored in file byte order at source, to floating point 
+// values in floatArray ( or doubleArray, if floatArray is NULL ).
+// Plain short and int arrays are not scaled.
+static void ConvertSamples( const ColumnData *columnData, const void *source, int32_t count, 
+							float *floatArray, double *doubleArray )
+{
 	switch ( columnData->type ) 
 	{
 		case ShortArrayType:
+			if ( floatArray != NULL )
+				ConvertShortArrayToFloat( source, count, 1.0, 0.0, floatArray );
+			else
+				ConvertShortArrayToDouble( source, count, 1.0, 0.0, doubleArray );
+			break;
+		case ScaledShortArrayType:
 		{
-			// create a new pointer to receive the converted data
-			long columnBytes = columnData->points * sizeof( float );
-			short *shortArray = columnData->shortArray;
-			float *floatArray = ( float * )malloc( columnBytes );
-			if ( floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Convert in the column data 
-			for ( int32_t i=0; i<columnData->points; i++ )
-			{
-				floatArray[i] = shortArray[i];
-			}
-			
-			// free old short array
-			free( columnData->shortArray );
-			columnData->shortArray = NULL;
-			
-			// pass in new float array
-			columnData->floatArray = floatArray;
-			columnData->type = FloatArrayType;
-			return result;
+			double scale = columnData->scaledShortArray.scale;
+			double offset = columnData->scaledShortArray.offset;
+			if ( floatArray != NULL )
+				ConvertShortArrayToFloat( source, count, scale, offset, floatArray );
+			else
+				ConvertShortArrayToDouble( source, count, scale, offset, doubleArray );
+			break;
 		}
 		case IntArrayType:
-		{
-			// create a new pointer to receive the converted data
-			long columnBytes = columnData->points * sizeof( float );
-			int *intArray = columnData->intArray;
-			float *floatArray = ( float * )malloc( columnBytes );
-			if ( floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Convert in the column data 
-			for ( int32_t i=0; i<columnData->points; i++ )
-			{
-				floatArray[i] = intArray[i];
-			}
-			
-			// free old short array
-			free( columnData->intArray );
-			columnData->intArray = NULL;
-			
-			// pass in new float array
-			columnData->floatArray = floatArray;
-			columnData->type = FloatArrayType;
-			return result;
-		}
+			if ( floatArray != NULL )
+				ConvertLongArrayToFloat( source, count, floatArray );
+			else
+				ConvertLongArrayToDouble( source, count, doubleArray );
+			break;
 		case FloatArrayType:
+			if ( floatArray != NULL )
+				ConvertFloatArrayToFloat( source, count, floatArray );
+			else
+				ConvertFloatArrayToDouble( source, count, doubleArray );
+			break;
+		case DoubleArrayType:
+			if ( floatArray != NULL )
+				ConvertDoubleArrayToFloat( source, count, floatArray );
+			else
+				ConvertDoubleArrayToDouble( source, count, doubleArray );
+			break;
+		default:
+			break;
+	}
+}
+
+
+// Read columnData->points samples from file position posn, converting them to 
+// floating point values in floatArray ( or doubleArray, if floatArray is NULL ) 
+// as they are read. Series columns are computed instead. The raw samples pass 
+// through a small staging buffer, or are converted directly from the mapping 
+// for files opened with OpenMappedFile, so no column-sized temporary array is 
+// needed. Positioned reads are used, so the file position is not used.
+static int ReadConvertedArray( const AGDataRef refNum, const int64_t posn, const ColumnData *columnData, 
+							   float *floatArray, double *doubleArray )
+{
+	int32_t points = columnData->points;
+	
+	if ( columnData->type == SeriesArrayType )
+	{
+		double firstValue = columnData->seriesArray.firstValue;
+		double increment = columnData->seriesArray.increment;
+		for ( int32_t i=0; i<points; i++ )
 		{
-			// Don't need to convert
-			return result;
+			if ( floatArray != NULL )
+				floatArray[i] = firstValue + i * increment;
+			else
+				doubleArray[i] = firstValue + i * increment;
 		}
+		return 0;
+	}
+	
+	int64_t elementBytes = ColumnElementBytes( columnData->type );
+	if ( elementBytes == 0 ) 
+		return kAG_FormatErr;
+	
+	// Mapped files need no staging 
+	int64_t columnBytes = points * elementBytes;
+	const void *mapped;
+	int result = MapFromFileAt( refNum, posn, &columnBytes, &mapped );
+	if ( mapped != NULL )
+	{
+		ConvertSamples( columnData, mapped, ( int32_t )( columnBytes / elementBytes ), floatArray, doubleArray );
+		return result;
+	}
+	
+	// Read and convert one buffer full at a time
+	double staging[kStagingBytes / sizeof( double )];
+	int32_t chunkPoints = ( int32_t )( kStagingBytes / elementBytes );
+	for ( int32_t i=0; i<points; i+=chunkPoints )
+	{
+		int32_t count = points - i < chunkPoints ? points - i : chunkPoints;
+		int64_t bytes = count * elementBytes;
+		result = ReadFromFileAt( refNum, posn + i * elementBytes, &bytes, staging );
+		
+		ConvertSamples( columnData, staging, ( int32_t )( bytes / elementBytes ), 
+						floatArray != NULL ? floatArray + i : NULL, 
+						doubleArray != NULL ? doubleArray + i : NULL );
+		if ( result ) 
+			return result;
+	}
+	
+	return 0;
+}
+
+
+int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+{
+	int64_t columnBytes;
+	int result = ReadColumnHeader( refNum, fileFormat, columnNumber, columnData, &columnBytes );
+	if ( result ) 
+		return result;
+	
+	if ( columnData->type == SeriesArrayType )
+		return result;
+	
+	result = CheckColumnInFile( refNum, columnBytes );
+	if ( result ) 
+		return result;
+	
+	return ReadColumnArray( refNum, columnData );
+}
+
+
+int AG_ReadColumnRange( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						int32_t start, int32_t stop, ColumnData *columnData )
+{
+	// Initialize in case of error during read
+	columnData->points = 0;
+	columnData->title = NULL;
+	
+	if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		return -1;
+	const ColumnIndexEntry *entry = &columnIndex->columns[columnNumber];
+	
+	// Clip the range to the column 
+	if ( stop > entry->column.points )
+		stop = entry->column.points;
+	if ( start < 0 )
+		start = 0;
+	if ( stop < start )
+		stop = start;
+	
+	// Copy the column description, including the title ( which is the same 
+	// size as the one allocated by AG_ReadColumn )
+	long titleBytes = 80;
+	if ( columnIndex->fileFormat == kAxoGraph_X_Format )
+		titleBytes = entry->column.titleLength > 0 ? entry->column.titleLength : 1;
+	
+	*columnData = entry->column;
+	columnData->points = stop - start;
+	columnData->title = ( unsigned char * )malloc( titleBytes );
+	if ( columnData->title == NULL ) 
+		return kAG_MemoryErr;
+	memcpy( columnData->title, entry->column.title, titleBytes );
+	
+	// A series column is computed, not stored, so just move its first value 
+	if ( columnData->type == SeriesArrayType )
+	{
+		columnData->seriesArray.firstValue += start * columnData->seriesArray.increment;
+		return 0;
+	}
+	
+	// Otherwise, read only the requested samples 
+	void *columnArray;
+	int result = AllocateColumnArray( columnData, &columnArray );
+	if ( result ) 
+		return result;
+	
+	return ReadSamplesAt( refNum, entry->dataPosition + start * ColumnElementBytes( columnData->type ), 
+						  columnData->type, columnData->points, columnArray );
+}
+
+
+int AG_ReadColumnRangeInto( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+							int32_t start, int32_t stop, void *columnArray )
+{
+	if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		return -1;
+	const ColumnIndexEntry *entry = &columnIndex->columns[columnNumber];
+	
+	// Clip the range to the column 
+	if ( stop > entry->column.points )
+		stop = entry->column.points;
+	if ( start < 0 )
+		start = 0;
+	if ( stop < start )
+		stop = start;
+	
+	// Series columns have no samples to read
+	if ( entry->column.type == SeriesArrayType )
+		return 0;
+	
+	return ReadSamplesAt( refNum, entry->dataPosition + start * ColumnElementBytes( entry->column.type ), 
+						  entry->column.type, stop - start, columnArray );
+}
+
+
+// Shared implementation of AG_ReadColumnAsFloat and AG_ReadColumnAsDouble
+static int ReadConvertedRange( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+							   int32_t start, int32_t stop, float *floatArray, double *doubleArray )
+{
+	if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		return -1;
+	const ColumnIndexEntry *entry = &columnIndex->columns[columnNumber];
+	
+	// Clip the range to the column 
+	if ( stop > entry->column.points )
+		stop = entry->column.points;
+	if ( start < 0 )
+		start = 0;
+	if ( stop < start )
+		stop = start;
+	
+	ColumnData columnData = entry->column;
+	columnData.points = stop - start;
+	if ( columnData.type == SeriesArrayType )
+		columnData.seriesArray.firstValue += start * columnData.seriesArray.increment;
+	
+	return ReadConvertedArray( refNum, entry->dataPosition + start * ColumnElementBytes( columnData.type ), 
+							   &columnData, floatArray, doubleArray );
+}
+
+
+int AG_ReadColumnAsFloat( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						  int32_t start, int32_t stop, float *floatArray )
+{
+	return ReadConvertedRange( refNum, columnIndex, columnNumber, start, stop, floatArray, NULL );
+}
+
+
+int AG_ReadColumnAsDouble( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						   int32_t start, int32_t stop, double *doubleArray )
+{
+	return ReadConvertedRange( refNum, columnIndex, columnNumber, start, stop, NULL, doubleArray );
+}
+
+
+int AG_GetMatrixShape( const ColumnIndex *columnIndex, int32_t *numberOfSweeps, int32_t *points )
+{
+	*numberOfSweeps = 0;
+	*points = 0;
+	if ( columnIndex->numberOfColumns < 2 )
+		return kAG_ShapeErr;
+	
+	int32_t timePoints = columnIndex->columns[0].column.points;
+	for ( int32_t c=1; c<columnIndex->numberOfColumns; c++ )
+		if ( columnIndex->columns[c].column.points != timePoints )
+			return kAG_ShapeErr;
+	
+	*numberOfSweeps = columnIndex->numberOfColumns - 1;
+	*points = timePoints;
+	return 0;
+}
+
+
+// Read each sweep column into its row of the matrix, converting as it goes
+static int ReadMatrix( const AGDataRef refNum, const ColumnIndex *columnIndex, float *floatMatrix, double *doubleMatrix )
+{
+	int32_t numberOfSweeps, points;
+	int result = AG_GetMatrixShape( columnIndex, &numberOfSweeps, &points );
+	
+	for ( int32_t s=0; result == 0 && s<numberOfSweeps; s++ )
+	{
+		int64_t row = ( int64_t )s * points;
+		if ( floatMatrix != NULL )
+			result = AG_ReadColumnAsFloat( refNum, columnIndex, s + 1, 0, points, floatMatrix + row );
+		else
+			result = AG_ReadColumnAsDouble( refNum, columnIndex, s + 1, 0, points, doubleMatrix + row );
+	}
+	return result;
+}
+
+
+int AG_ReadMatrixAsFloat( const AGDataRef refNum, const ColumnIndex *columnIndex, float *matrix )
+{
+	return ReadMatrix( refNum, columnIndex, matrix, NULL );
+}
+
+
+int AG_ReadMatrixAsDouble( const AGDataRef refNum, const ColumnIndex *columnIndex, double *matrix )
+{
+	return ReadMatrix( refNum, columnIndex, NULL, matrix );
+}
+
+
+// Widen the lowest and highest of count native samples of the given type,
+// before scaling, into *low and *high
+template <typename T>
+static void WidenEnvelope( const T *samples, const int32_t count, double *low, double *high )
+{
+	SampleExtremes<T> extremes;
+	FindSampleExtremes( samples, count, &extremes );
+	if ( extremes.low > extremes.high )
+		return;
+	if ( extremes.low < *low )
+		*low = extremes.low;
+	if ( extremes.high > *high )
+		*high = extremes.high;
+}
+
+static void WidenEnvelopeSamples( const ColumnType type, const void *samples, const int32_t count, double *low, double *high )
+{
+	switch ( type )
+	{
+		case ShortArrayType:
+		case ScaledShortArrayType:
+			WidenEnvelope( ( const int16_t * )samples, count, low, high );
+			break;
+		case IntArrayType:
+			WidenEnvelope( ( const int32_t * )samples, count, low, high );
+			break;
+		case FloatArrayType:
+			WidenEnvelope( ( const float * )samples, count, low, high );
+			break;
 		case DoubleArrayType:
+			WidenEnvelope( ( const double * )samples, count, low, high );
+			break;
+		default:
+			break;
+	}
+}
+
+// The first sample of bin b, when points samples are split into bins bins
+static int32_t EnvelopeBinStart( const int32_t points, const int32_t bins, const int32_t b )
+{
+	return ( int32_t )( ( int64_t )b * points / bins );
+}
+
+
+int AG_ReadColumnEnvelope( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber,
+						   const int32_t bins, double *minima, double *maxima )
+{
+	if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		return -1;
+	const ColumnIndexEntry *entry = &columnIndex->columns[columnNumber];
+	const ColumnData *columnData = &entry->column;
+	int32_t points = columnData->points;
+	if ( bins <= 0 )
+		return 0;
+
+	double scale = 1;
+	double offset = 0;
+	if ( columnData->type == ScaledShortArrayType )
+	{
+		scale = columnData->scaledShortArray.scale;
+		offset = columnData->scaledShortArray.offset;
+	}
+	else if ( columnData->type == SeriesArrayType )
+	{
+		scale = columnData->seriesArray.increment;
+		offset = columnData->seriesArray.firstValue;
+	}
+
+	// Gather the unscaled extremes of each bin, which start out empty
+	for ( int32_t b=0; b<bins; b++ )
+	{
+		minima[b] = HUGE_VAL;
+		maxima[b] = -HUGE_VAL;
+	}
+
+	if ( columnData->type == SeriesArrayType )
+	{
+		// A series is sample number times increment plus first value
+		for ( int32_t b=0; b<bins; b++ )
 		{
-			// create a new pointer to receive the converted data
-			long columnBytes = columnData->points * sizeof( float );
-			double *doubleArray = columnData->doubleArray;
-			float *floatArray = ( float * )malloc( columnBytes );
-			if ( floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Convert in the column data 
-			for ( int32_t i=0; i<columnData->points; i++ )
+			int32_t first = EnvelopeBinStart( points, bins, b );
+			int32_t stop = EnvelopeBinStart( points, bins, b + 1 );
+			if ( stop > first )
 			{
-				floatArray[i] = doubleArray[i];
+				minima[b] = first;
+				maxima[b] = stop - 1;
 			}
-			
-			// free old short array
-			free( columnData->doubleArray );
-			columnData->doubleArray = NULL;
-			
-			// pass in new float array
-			columnData->floatArray = floatArray;
-			columnData->type = FloatArrayType;
-			return result;
 		}
-		case SeriesArrayType:
+	}
+	else
+	{
+		int64_t elementBytes = ColumnElementBytes( columnData->type );
+		if ( elementBytes == 0 )
+			return kAG_FormatErr;
+		// Mapped files are swapped into the staging buffer straight from the
+		// mapping; others are read into it and swapped there
+		int64_t columnBytes = points * elementBytes;
+		const void *mapped;
+		int result = MapFromFileAt( refNum, entry->dataPosition, &columnBytes, &mapped );
+		if ( mapped != NULL && result )
+			return result;
+
+		double staging[kStagingBytes / sizeof( double )];
+		int32_t chunkPoints = ( int32_t )( kStagingBytes / elementBytes );
+		int32_t b = 0;
+		for ( int32_t i=0; i<points; i+=chunkPoints )
 		{
-			// create a new pointer to receive the converted data
-			long columnBytes = columnData->points * sizeof( float );
-			double firstValue = columnData->seriesArray.firstValue;
-			double increment = columnData->seriesArray.increment;
-			float *floatArray = ( float * )malloc( columnBytes );
-			if ( floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Convert in the column data 
-			for ( int32_t i=0; i<columnData->points; i++ )
+			int32_t count = points - i < chunkPoints ? points - i : chunkPoints;
+			if ( mapped != NULL )
 			{
-				floatArray[i] = firstValue + i * increment;
+				const unsigned char *source = ( const unsigned char * )mapped + i * elementBytes;
+#ifdef __LITTLE_ENDIAN__
+				ByteSwapCopyArray( source, staging, count, ( int )elementBytes );
+#else
+				memcpy( staging, source, count * elementBytes );
+#endif
 			}
-			
-			// pass in new float array
-			columnData->floatArray = floatArray;
-			columnData->type = FloatArrayType;
-			return result;
-		}
-		case ScaledShortArrayType:
-		{
-			// create a new pointer to receive the converted data
-			long columnBytes = columnData->points * sizeof( float );
-			double scale = columnData->scaledShortArray.scale;
-			double offset = columnData->scaledShortArray.offset;
-			short *shortArray = columnData->scaledShortArray.shortArray;
-			float *floatArray = ( float * )malloc( columnBytes );
-			if ( floatArray == NULL ) 
-				return kAG_MemoryErr;
-			
-			// Convert in the column data 
-			for ( int32_t i=0; i<columnData->points; i++ )
+			else
 			{
-				floatArray[i] = shortArray[i] * scale + offset;
+				result = ReadSamplesAt( refNum, entry->dataPosition + i * elementBytes, columnData->type, count, staging );
+				if ( result )
+					return result;
+			}
+
+			// Split the chunk at the bin boundaries inside it
+			const unsigned char *samples = ( const unsigned char * )staging;
+			for ( int32_t j=i; j<i+count; )
+			{
+				while ( EnvelopeBinStart( points, bins, b + 1 ) <= j )
+					b++;
+				int32_t stop = EnvelopeBinStart( points, bins, b + 1 );
+				if ( stop > i + count )
+					stop = i + count;
+				WidenEnvelopeSamples( columnData->type, samples + ( j - i ) * elementBytes, stop - j,
+									  &minima[b], &maxima[b] );
+				j = stop;
 			}
-			
-			// free old short array
-			free( columnData->scaledShortArray.shortArray );
-			columnData->scaledShortArray.shortArray = NULL;
-			
-			// pass in new float array
-			columnData->floatArray = floatArray;
-			columnData->type = FloatArrayType;
-			return result;
 		}
-		default:
+	}
+
+	// Scale the extremes, which swap places if the scale is negative
+	for ( int32_t b=0; b<bins; b++ )
+	{
+		if ( minima[b] > maxima[b] )
 		{
-			return result;
+			minima[b] = NAN;
+			maxima[b] = NAN;
+			continue;
 		}
+		double low = minima[b] * scale + offset;
+		double high = maxima[b] * scale + offset;
+		minima[b] = scale < 0 ? high : low;
+		maxima[b] = scale < 0 ? low : high;
+	}
+	return 0;
+}
+
+
+int AG_MapColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+{
+	int64_t columnBytes;
+	int result = ReadColumnHeader( refNum, fileFormat, columnNumber, columnData, &columnBytes );
+	if ( result ) 
+		return result;
+	
+	if ( columnData->type == SeriesArrayType )
+		return result;
+	
+	// Point straight into the mapping; the data stays in file byte order
+	const void *columnArray;
+	result = MapFromFile( refNum, &columnBytes, &columnArray );
+	SetColumnArray( columnData, ( void * )columnArray );
+	
+	return result;
+}
+
+
+int AG_BuildColumnIndex( const AGDataRef refNum, ColumnIndex *columnIndex )
+{
+	memset( columnIndex, 0, sizeof( ColumnIndex ) );
+	
+	int result = AG_GetFileFormat( refNum, &columnIndex->fileFormat );
+	if ( result ) 
+		return result;
+	
+	// AG_GetFileFormat reports every AxoGraph X version as the latest one, 
+	// so go back and read the version actually stored in the file
+	result = SetFilePosition( refNum, 4 );
+	if ( result ) 
+		return result;
+	
+	if ( columnIndex->fileFormat == kAxoGraph_X_Format )
+	{
+		int32_t version;
+		int64_t bytes = sizeof( int32_t );
+		result = ReadFromFile( refNum, &bytes, &version );
+#ifdef __LITTLE_ENDIAN__
+		ByteSwapLong( &version );
+#endif
+		columnIndex->fileVersion = version;
+	}
+	else
+	{
+		short version;
+		int64_t bytes = sizeof( short );
+		result = ReadFromFile( refNum, &bytes, &version );
+#ifdef __LITTLE_ENDIAN__
+		ByteSwapShort( &version );
+#endif
+		columnIndex->fileVersion = version;
 	}
+	if ( result ) 
+		return result;
+	
+	int32_t numberOfColumns;
+	result = AG_GetNumberOfColumns( refNum, columnIndex->fileFormat, &numberOfColumns );
+	if ( result ) 
+		return result;
+	if ( numberOfColumns < 0 )
+		return kAG_FormatErr;
+	
+	// ( one spare entry, so that an empty file still gets a valid pointer )
+	columnIndex->columns = ( ColumnIndexEntry * )calloc( numberOfColumns + 1, sizeof( ColumnIndexEntry ) );
+	if ( columnIndex->columns == NULL ) 
+		return kAG_MemoryErr;
+	
+	int64_t fileLength;
+	result = GetFileLength( refNum, &fileLength );
+	if ( result ) 
+		return result;
+	
+	// Walk the column headers, skipping over the sample data, which must 
+	// lie within the file; a damaged point count would otherwise have 
+	// readers allocate gigabytes before the read fails
+	for ( int32_t columnNumber = 0; columnNumber < numberOfColumns; columnNumber++ )
+	{
+		ColumnIndexEntry *entry = &columnIndex->columns[columnNumber];
+		
+		result = GetFilePosition( refNum, &entry->headerPosition );
+		if ( result ) 
+			return result;
+		
+		result = ReadColumnHeader( refNum, columnIndex->fileFormat, columnNumber, 
+								   &entry->column, &entry->dataBytes );
+		columnIndex->numberOfColumns = columnNumber + 1;	// so the title gets freed
+		if ( result ) 
+			return result;
+		
+		result = GetFilePosition( refNum, &entry->dataPosition );
+		if ( result ) 
+			return result;
+		if ( entry->dataBytes > fileLength - entry->dataPosition )
+			return kAG_FormatErr;
+		
+		result = SetFilePosition( refNum, entry->dataPosition + entry->dataBytes );
+		if ( result ) 
+			return result;
+	}
+	
+	return GetFilePosition( refNum, &columnIndex->trailerPosition );
+}
+
+
+void AG_FreeColumnIndex( ColumnIndex *columnIndex )
+{
+	if ( columnIndex->columns != NULL )
+	{
+		for ( int32_t i = 0; i < columnIndex->numberOfColumns; i++ )
+			free( columnIndex->columns[i].column.title );
+		free( columnIndex->columns );
+	}
+	columnIndex->columns = NULL;
+	columnIndex->numberOfColumns = 0;
+}
+
+
+int AG_SeekColumn( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber )
+{
+	if ( columnNumber < 0 || columnNumber >= columnIndex->numberOfColumns )
+		return -1;
+	
+	return SetFilePosition( refNum, columnIndex->columns[columnNumber].headerPosition );
+}
+
+
+int AG_ReadFloatColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+{
+	int64_t columnBytes;
+	int result = ReadColumnHeader( refNum, fileFormat, columnNumber, columnData, &columnBytes );
+	if ( result == 0 )
+		result = CheckColumnInFile( refNum, columnBytes );
+	if ( result ) 
+		return result;
+	
+	// create a new pointer to receive the converted data
+	float *floatArray = ( float * )malloc( ( size_t )columnData->points * sizeof( float ) );
+	if ( floatArray == NULL ) 
+		return kAG_MemoryErr;
+	
+	// Read and convert the column data in one pass, then move past it
+	int64_t posn;
+	result = GetFilePosition( refNum, &posn );
+	if ( result == 0 )
+		result = ReadConvertedArray( refNum, posn, columnData, floatArray, NULL );
+	if ( result == 0 )
+		result = SetFilePosition( refNum, posn + columnBytes );
+	
+	// pass in new float array
+	columnData->floatArray = floatArray;
+	columnData->type = FloatArrayType;
+	return result;
 }
 
 
@@ -562,7 +1099,7 @@ int AG_WriteHeader( const AGDataRef refNum, const int fileFormat, const int32_t
 			return result;
 		
 		// Write the file prefix 
-		long bytes = 4;
+		int64_t bytes = 4;
 		result = WriteToFile( refNum, &bytes, AxoGraphFileID );	// write the prefix 
 		if ( result ) 
 			return result;
@@ -596,7 +1133,7 @@ int AG_WriteHeader( const AGDataRef refNum, const int fileFormat, const int32_t
 			return result;
 
 		// Write the file prefix 
-		long bytes = 4;
+		int64_t bytes = 4;
 		result = WriteToFile( refNum, &bytes, AxoGraphFileID );	// write the prefix 
 		if ( result ) 
 			return result;
@@ -622,7 +1159,206 @@ int AG_WriteHeader( const AGDataRef refNum, const int fileFormat, const int32_t
 
 
 
-int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData )
+// The range of the values written so far to a column, kept up to date a 
+// block at a time as the samples are staged for writing
+struct RangeAccumulator {
+	double scale;
+	double offset;
+	double minimum;
+	double maximum;
+	double minimumPositive;
+	double last;
+	bool increasing;
+};
+
+static void StartRange( RangeAccumulator *accumulator, const double scale, const double offset )
+{
+	accumulator->scale = scale;
+	accumulator->offset = offset;
+	accumulator->minimum = HUGE_VAL;
+	accumulator->maximum = -HUGE_VAL;
+	accumulator->minimumPositive = HUGE_VAL;
+	accumulator->last = -HUGE_VAL;
+	accumulator->increasing = true;
+}
+
+// The samples are scanned as stored, then the extremes scaled. With no 
+// offset, the smallest scaled value above zero comes from the sample nearest 
+// zero on the side the scale maps above it; otherwise it is found from the 
+// scaled samples.
+template <typename T>
+static void AccumulateRange( RangeAccumulator *accumulator, const T *samples, const int32_t count )
+{
+	if ( count == 0 )
+		return;
+	
+	const double scale = accumulator->scale;
+	const double offset = accumulator->offset;
+	SampleExtremes<T> extremes;
+	FindSampleExtremes( samples, count, &extremes );
+	
+	int increasing = 1;
+	int decreasing = 1;
+	for ( int32_t i=1; i<count; i++ )
+	{
+		increasing &= ( samples[i] > samples[i-1] );
+		decreasing &= ( samples[i] < samples[i-1] );
+	}
+	
+	double first = samples[0] * scale + offset;
+	double last = samples[count-1] * scale + offset;
+	double scaledLow = extremes.low * scale + offset;
+	double scaledHigh = extremes.high * scale + offset;
+	if ( scale < 0 )
+	{
+		double swap = scaledLow;
+		scaledLow = scaledHigh;
+		scaledHigh = swap;
+	}
+	
+	double minimumPositive = HUGE_VAL;
+	if ( offset == 0 && scale != 0 )
+	{
+		if ( scale > 0 && extremes.high > 0 )
+			minimumPositive = extremes.lowestAboveZero * scale;
+		if ( scale < 0 && extremes.low < 0 )
+			minimumPositive = extremes.highestBelowZero * scale;
+	}
+	else if ( scaledHigh > 0 )
+	{
+		for ( int32_t i=0; i<count; i++ )
+		{
+			double value = samples[i] * scale + offset;
+			minimumPositive = ( value > 0 && value < minimumPositive ) ? value : minimumPositive;
+		}
+	}
+	
+	if ( scaledLow < accumulator->minimum )
+		accumulator->minimum = scaledLow;
+	if ( scaledHigh > accumulator->maximum )
+		accumulator->maximum = scaledHigh;
+	if ( minimumPositive < accumulator->minimumPositive )
+		accumulator->minimumPositive = minimumPositive;
+	accumulator->increasing = accumulator->increasing && first > accumulator->last && 
+							  ( scale > 0 ? increasing : ( scale < 0 && decreasing ) || count == 1 );
+	accumulator->last = last;
+}
+
+static void AccumulateSamples( RangeAccumulator *accumulator, const ColumnType type, const void *samples, const int32_t count )
+{
+	switch ( type ) 
+	{
+		case ShortArrayType:
+			AccumulateRange( accumulator, ( const int16_t * )samples, count );
+			break;
+		case IntArrayType:
+			AccumulateRange( accumulator, ( const int32_t * )samples, count );
+			break;
+		case FloatArrayType:
+			AccumulateRange( accumulator, ( const float * )samples, count );
+			break;
+		case DoubleArrayType:
+			AccumulateRange( accumulator, ( const double * )samples, count );
+			break;
+		default:
+			break;
+	}
+}
+
+static void FinishRange( const RangeAccumulator *accumulator, ColumnRange *range )
+{
+	bool empty = accumulator->minimum > accumulator->maximum;
+	range->minimum = empty ? 0 : accumulator->minimum;
+	range->maximum = empty ? 0 : accumulator->maximum;
+	range->minimumPositive = accumulator->minimumPositive == HUGE_VAL ? 0 : accumulator->minimumPositive;
+	range->monotonic = accumulator->increasing;
+	range->regularlySpaced = false;
+	range->interval = 0;
+}
+
+// The range of a series column follows from its first value and increment
+static void SeriesRange( const int32_t points, const double firstValue, const double increment, ColumnRange *range )
+{
+	double lastValue = firstValue + ( points - 1 ) * increment;
+	bool empty = ( points <= 0 );
+	range->minimum = empty ? 0 : ( increment < 0 ? lastValue : firstValue );
+	range->maximum = empty ? 0 : ( increment < 0 ? firstValue : lastValue );
+	
+	// The smallest positive value is next to where the series crosses zero
+	double crossing = increment != 0 ? floor( -firstValue / increment ) : 0;
+	if ( crossing > points - 1 )
+		crossing = points - 1;
+	if ( crossing < 0 )
+		crossing = 0;
+	range->minimumPositive = 0;
+	for ( int j=-1; j<=1; j++ )
+	{
+		double k = crossing + j;
+		if ( k < 0 || k > points - 1 )
+			continue;
+		double value = firstValue + k * increment;
+		if ( value > 0 && ( range->minimumPositive == 0 || value < range->minimumPositive ) )
+			range->minimumPositive = value;
+	}
+	
+	range->monotonic = ( increment > 0 || points < 2 );
+	range->regularlySpaced = true;
+	range->interval = increment;
+}
+
+
+// Write points samples of the given type from columnArray, in file byte 
+// order. On little endian machines the samples are byte swapped into a small 
+// staging buffer and written from there a block at a time, so the caller's 
+// array is never modified. If range is not NULL, it is set to the range of 
+// the samples times scale plus offset, found a block at a time just before 
+// each is staged, while it is in the cache, rather than in a separate pass.
+static int WriteSamples( const AGDataRef refNum, const void *columnArray, const ColumnType type, const int32_t points, 
+						 const double scale, const double offset, ColumnRange *range )
+{
+	int64_t elementBytes = ColumnElementBytes( type );
+	RangeAccumulator accumulator;
+	StartRange( &accumulator, scale, offset );
+	
+#ifdef __LITTLE_ENDIAN__
+	double staging[kStagingBytes / sizeof( double )];
+	int32_t chunkPoints = ( int32_t )( kStagingBytes / elementBytes );
+	const unsigned char *source = ( const unsigned char * )columnArray;
+	for ( int32_t i=0; i<points; i+=chunkPoints )
+	{
+		int32_t count = points - i < chunkPoints ? points - i : chunkPoints;
+		if ( range != NULL )
+			AccumulateSamples( &accumulator, type, source + i * elementBytes, count );
+		ByteSwapCopyArray( source + i * elementBytes, staging, count, ( int )elementBytes );
+		
+		int64_t bytes = count * elementBytes;
+		int result = WriteToFile( refNum, &bytes, staging );
+		if ( result ) 
+			return result;
+	}
+	if ( range != NULL )
+		FinishRange( &accumulator, range );
+	return 0;
+#else
+	if ( range != NULL )
+	{
+		AccumulateSamples( &accumulator, type, columnArray, points );
+		FinishRange( &accumulator, range );
+	}
+	int64_t bytes = points * elementBytes;
+	return WriteToFile( refNum, &bytes, ( void * )columnArray );
+#endif
+}
+
+
+int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, const ColumnData *columnData )
+{
+	return AG_WriteColumnWithRange( refNum, fileFormat, columnNumber, columnData, NULL );
+}
+
+
+int AG_WriteColumnWithRange( const AGDataRef refNum, const int fileFormat, const int columnNumber, const ColumnData *columnData, 
+							 ColumnRange *range )
 {
 	switch ( fileFormat ) 
 	{
@@ -639,23 +1375,13 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 #endif
 			
 			// Write ColumnHeader  
-			long bytes = sizeof( ColumnHeader );
+			int64_t bytes = sizeof( ColumnHeader );
 			int result = WriteToFile( refNum, &bytes, &columnHeader );
 			if ( result )
 				return result;
 			
-#ifdef __LITTLE_ENDIAN__
-			ByteSwapLong( &columnHeader.points );
-			ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-			
 			// Write the data 
-			bytes = sizeof( float ) * columnData->points;
-			result = WriteToFile( refNum, &bytes, columnData->floatArray );
-#ifdef __LITTLE_ENDIAN__
-			ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-			return result;
+			return WriteSamples( refNum, columnData->floatArray, FloatArrayType, columnData->points, 1, 0, range );
 		}
 			
 		case kAxoGraph_Digitized_Format:
@@ -677,7 +1403,7 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 #endif
 				
 				// Write ColumnHeader 
-				long bytes = sizeof( DigitizedFirstColumnHeader );
+				int64_t bytes = sizeof( DigitizedFirstColumnHeader );
 				int result = WriteToFile( refNum, &bytes, &columnHeader );				
 
 #ifdef __LITTLE_ENDIAN__
@@ -685,6 +1411,8 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 				ByteSwapFloat( &columnHeader.firstPoint );
 				ByteSwapFloat( &columnHeader.sampleInterval );
 #endif
+				if ( range != NULL )
+					SeriesRange( columnData->points, columnData->seriesArray.firstValue, columnData->seriesArray.increment, range );
 				return result;
 			}
 			else
@@ -703,24 +1431,14 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 #endif
 				
 				// Write ColumnHeader
-				long bytes = sizeof( DigitizedColumnHeader );
+				int64_t bytes = sizeof( DigitizedColumnHeader );
 				int result = WriteToFile( refNum, &bytes, &columnHeader );
 				if ( result ) 
 					return result;
 				
-#ifdef __LITTLE_ENDIAN__
-				ByteSwapLong( &columnHeader.points );
-				ByteSwapFloat( &columnHeader.scalingFactor );
-				ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-				
 				// Write the data 
-				bytes = sizeof( short ) * columnData->points;
-				result = WriteToFile( refNum, &bytes, columnData->scaledShortArray.shortArray );
-#ifdef __LITTLE_ENDIAN__
-				ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-				return result;
+				return WriteSamples( refNum, columnData->scaledShortArray.shortArray, ShortArrayType, columnData->points, 
+									 columnData->scaledShortArray.scale, 0, range );
 			}
 		}
 			
@@ -740,21 +1458,20 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 #endif
 			
 			// Write ColumnHeader
-			long bytes = sizeof( AxoGraphXColumnHeader );
+			int64_t bytes = sizeof( AxoGraphXColumnHeader );
 			int result = WriteToFile( refNum, &bytes, &columnHeader );
 			if ( result )
 				return result;
 		
-#ifdef __LITTLE_ENDIAN__
-			ByteSwapLong( &columnHeader.points );
-			ByteSwapLong( &columnHeader.dataType );
-			ByteSwapLong( &columnHeader.titleLength );
-#endif
-
-			// Write Column title
-			CStringToUnicode( columnData->title, columnData->titleLength );
-			long titleLength = columnData->titleLength;
-            result = WriteToFile( refNum, &titleLength, columnData->title );
+			// Write Column title, converted in a copy of the C string
+			int64_t titleLength = columnData->titleLength;
+			unsigned char *title = ( unsigned char * )malloc( titleLength > 0 ? titleLength : 1 );
+			if ( title == NULL ) 
+				return kAG_MemoryErr;
+			memcpy( title, columnData->title, titleLength / 2 );
+			CStringToUnicode( title, columnData->titleLength );
+            result = WriteToFile( refNum, &titleLength, title );
+			free( title );
 			if ( result )
 				return result;
 		
@@ -763,55 +1480,19 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 			{
 				case ShortArrayType:
 				{
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->shortArray, columnHeader.points );
-#endif
-					
-					bytes = sizeof( short ) * columnData->points;
-					result = WriteToFile( refNum, &bytes, columnData->shortArray );
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->shortArray, columnHeader.points );
-#endif
-					return result;
+					return WriteSamples( refNum, columnData->shortArray, ShortArrayType, columnData->points, 1, 0, range );
 				}
 				case IntArrayType:
 				{
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapLongArray( (int32_t *)columnData->intArray, columnHeader.points );
-#endif
-					
-					bytes = sizeof( int ) * columnData->points;
-					result = WriteToFile( refNum, &bytes, columnData->intArray );
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapLongArray( (int32_t *)columnData->intArray, columnHeader.points );
-#endif
-					return result;
+					return WriteSamples( refNum, columnData->intArray, IntArrayType, columnData->points, 1, 0, range );
 				}
 				case FloatArrayType:
 				{
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-					
-					bytes = sizeof( float ) * columnData->points;
-					result = WriteToFile( refNum, &bytes, columnData->floatArray );
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapFloatArray( columnData->floatArray, columnHeader.points );
-#endif
-					return result;
+					return WriteSamples( refNum, columnData->floatArray, FloatArrayType, columnData->points, 1, 0, range );
 				}
 				case DoubleArrayType:
 				{
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapDoubleArray( columnData->doubleArray, columnHeader.points );
-#endif
-					
-					bytes = sizeof( double ) * columnData->points;
-					result = WriteToFile( refNum, &bytes, columnData->doubleArray );
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapDoubleArray( columnData->doubleArray, columnHeader.points );
-#endif
-					return result;
+					return WriteSamples( refNum, columnData->doubleArray, DoubleArrayType, columnData->points, 1, 0, range );
 				}
 				case SeriesArrayType:
 				{
@@ -826,6 +1507,8 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 					
 					result = WriteToFile( refNum, &bytes, &firstValue );
 					result = WriteToFile( refNum, &bytes, &increment );
+					if ( range != NULL )
+						SeriesRange( columnData->points, columnData->seriesArray.firstValue, columnData->seriesArray.increment, range );
 					return result;
 				}
 				case ScaledShortArrayType:
@@ -842,16 +1525,8 @@ int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int colu
 					result = WriteToFile( refNum, &bytes, &scale );
 					result = WriteToFile( refNum, &bytes, &offset );
 					
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-					
-					bytes = sizeof( short ) * columnData->points;
-					result = WriteToFile( refNum, &bytes, columnData->scaledShortArray.shortArray );
-#ifdef __LITTLE_ENDIAN__
-					ByteSwapShortArray( columnData->scaledShortArray.shortArray, columnHeader.points );
-#endif
-					return result;
+					return WriteSamples( refNum, columnData->scaledShortArray.shortArray, ShortArrayType, columnData->points, 
+										 columnData->scaledShortArray.scale, columnData->scaledShortArray.offset, range );
 				}
 				default:
 				{
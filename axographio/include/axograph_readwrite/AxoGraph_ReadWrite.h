@@ -192,6 +192,7 @@ Header for each trace
 const int16_t kAG_MemoryErr = -21;
 const int16_t kAG_FormatErr = -23;
 const int16_t kAG_VersionErr = -24;
+const int16_t kAG_ShapeErr = -26;			// a column has the wrong number of points
 
 // file format id's
 const int16_t kAxoGraph_Graph_Format = 1;
@@ -286,6 +287,40 @@ struct ColumnData {
 
 
 
+// The range of the values in a column, as found by AG_WriteColumnWithRange
+struct ColumnRange {
+	double minimum;				// 0 for an empty column
+	double maximum;
+	double minimumPositive;		// 0 if no value is positive
+	bool monotonic;				// true if each value > previous value
+	bool regularlySpaced;		// true for series columns
+	double interval;			// the increment of a series column
+};
+
+
+
+//============= ColumnIndex structure ======================
+
+// Location and description of one column, without its sample data.
+// The column member holds the type, number of points, title, and any series
+// or scaling parameters; its sample array pointer is unused.
+struct ColumnIndexEntry {
+	int64_t headerPosition;		// file position of the column header
+	int64_t dataPosition;		// file position of the first sample
+	int64_t dataBytes;			// size of the sample array ( 0 for series columns )
+	ColumnData column;
+};
+
+struct ColumnIndex {
+	int fileFormat;
+	int fileVersion;			// format ID as stored in the file header
+	int32_t numberOfColumns;
+	int64_t trailerPosition;	// file position just past the last column
+	ColumnIndexEntry *columns;
+};
+
+
+
 int AG_GetFileFormat( const AGDataRef refNum, int *fileFormat );
 
 //	Check that the file referenced by refNum is an AxoGraph data file
@@ -311,7 +346,16 @@ int AG_ReadColumn( const AGDataRef refNum, const int fileFormat, const int colum
 //	Returns data in a pointer in structure that contains the number of points,
 //  the column title, and the column data.
 //	This function allocates new pointers of the appropriate size, reads the data into 
-//	them and returns it in columnData.  
+//	them and returns it in columnData.
+
+int AG_MapColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData );
+
+//	Read in a column from an AxoGraph data file opened with OpenMappedFile.
+//	Called once for each column in the file, like AG_ReadColumn.
+//	Only the column title is allocated. The array pointers in columnData point
+//	directly into the file mapping, so the data are NOT byte swapped (they are
+//	big-endian, as stored in the file), must not be modified or freed, and
+//	are only valid until the file is closed.
 
 int AG_ReadFloatColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData );
 
@@ -323,6 +367,91 @@ int AG_ReadFloatColumn( const AGDataRef refNum, const int fileFormat, const int
 //	This function allocates new pointers of the appropriate size, reads the data into 
 //	them and returns it in columnData.  
 
+int AG_BuildColumnIndex( const AGDataRef refNum, ColumnIndex *columnIndex );
+
+//	Check the file format and list every column in the file, reading only the
+//	column headers and seeking past the sample data. Columns can then be read
+//	in any order by calling AG_SeekColumn before AG_ReadColumn or AG_MapColumn.
+//	Returns 0 if all goes well, the same errors as AG_GetFileFormat, or
+//	kAG_FormatErr if a column has a negative number of points or its samples
+//	run past the end of the file.
+//	The index must be released with AG_FreeColumnIndex, even after an error.
+//	The functions below that read samples through a column index ( from
+//	AG_ReadColumnRange to AG_ReadColumnEnvelope ) use positioned reads ( see
+//	ReadFromFileAt ), so for files opened with OpenPositionedFile or
+//	OpenMappedFile they may be called from several threads at once, on one
+//	file and one index, to decode columns in parallel.
+
+void AG_FreeColumnIndex( ColumnIndex *columnIndex );
+
+//	Free the titles and entries allocated by AG_BuildColumnIndex.
+
+int AG_SeekColumn( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber );
+
+//	Position the file at the header of the given column, ready for AG_ReadColumn.
+
+int AG_ReadColumnRange( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						int32_t start, int32_t stop, ColumnData *columnData );
+
+//	Read in the samples start <= i < stop of a column listed in a column index
+//	( see AG_BuildColumnIndex ), seeking directly to the first requested sample.
+//	The range is clipped to the column. For series columns, the first value is
+//	adjusted and nothing is read. Otherwise works like AG_ReadColumn, allocating 
+//	new pointers for the title and data that the caller must free.
+
+int AG_ReadColumnRangeInto( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+							int32_t start, int32_t stop, void *columnArray );
+
+//	Read in the samples start <= i < stop of a column listed in a column index,
+//	clipped to the column as in AG_ReadColumnRange, into an array provided by
+//	the caller instead of a newly allocated one. The array must have room for
+//	all of the samples, stored as the column type in columnIndex ( short for 
+//	scaled shorts ), and they are byte swapped to native order in place. 
+//	The scale and offset of scaled shorts, and the parameters of series 
+//	columns, which read nothing, are in the index entry of the column.
+
+int AG_ReadColumnAsFloat( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						  int32_t start, int32_t stop, float *floatArray );
+int AG_ReadColumnAsDouble( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber, 
+						   int32_t start, int32_t stop, double *doubleArray );
+
+//	Read in the samples start <= i < stop of a column listed in a column index,
+//	clipped to the column as in AG_ReadColumnRange, converting them to floating
+//	point values in the caller's array, which must have room for all of them.
+//	Scaled short columns are scaled and series columns are computed; other
+//	types are converted without scaling, as in AG_ReadFloatColumn. The file is
+//	read and converted a small block at a time, so nothing is allocated.
+//	Works for files opened with either OpenFile or OpenMappedFile.
+
+int AG_GetMatrixShape( const ColumnIndex *columnIndex, int32_t *numberOfSweeps, int32_t *points );
+
+//	For an episodic file, whose first column is the time column shared by the 
+//	sweeps in all the others, find the number of sweeps ( columns after the 
+//	first ) and the points in each. Returns kAG_ShapeErr if there are no sweeps, 
+//	or if any column has a different number of points than the time column.
+
+int AG_ReadMatrixAsFloat( const AGDataRef refNum, const ColumnIndex *columnIndex, float *matrix );
+
+int AG_ReadMatrixAsDouble( const AGDataRef refNum, const ColumnIndex *columnIndex, double *matrix );
+
+//	Read every sweep of an episodic file ( see AG_GetMatrixShape ) straight into 
+//	one array of numberOfSweeps rows of points values, converted as by 
+//	AG_ReadColumnAsFloat or AG_ReadColumnAsDouble, so scaled short columns are 
+//	scaled as they are decoded. The time column itself is not read.
+
+int AG_ReadColumnEnvelope( const AGDataRef refNum, const ColumnIndex *columnIndex, const int columnNumber,
+						   const int32_t bins, double *minima, double *maxima );
+
+//	Split a column listed in a column index into bins runs of consecutive
+//	samples, as equal in length as possible ( bin b starts at sample
+//	b * points / bins ), and find the lowest and highest value in each, for
+//	drawing the column at one bin per pixel. Values are converted as by
+//	AG_ReadColumnAsDouble; bins with no samples, or only NaN samples, get NaN.
+//	The samples are read and byte swapped a small block at a time and each
+//	block is scanned as it arrives, so memory use does not grow with the
+//	column, and series columns are not read at all.
+//	Works for files opened with either OpenFile or OpenMappedFile.
+
 // ......................................................................................
 
 int AG_WriteHeader( const AGDataRef refNum, const int fileFormat, const int32_t numberOfColumns );
@@ -331,10 +460,20 @@ int AG_WriteHeader( const AGDataRef refNum, const int fileFormat, const int32_t
 //	Returns 0 if all goes well, or the error code if one occurs.
 
 	
-int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, ColumnData *columnData );
+int AG_WriteColumn( const AGDataRef refNum, const int fileFormat, const int columnNumber, const ColumnData *columnData );
 
 //	Write out a column to an AxoGraph data file.
 //	Called once for each column in the file.  
+//	columnData is not modified: the data are byte swapped into a small buffer 
+//	as they are written, so they may be read-only or shared with other threads.
+
+int AG_WriteColumnWithRange( const AGDataRef refNum, const int fileFormat, const int columnNumber, const ColumnData *columnData, 
+							 ColumnRange *range );
+
+//	Write out a column as AG_WriteColumn does, and also find the range of its 
+//	values ( scaled, for scaled short columns ), as stored in AxoGraph X trace 
+//	headers. Each block of samples is scanned just before it is byte swapped 
+//	for writing, so this takes no extra pass over the data. range may be NULL.
 
 
 #endif
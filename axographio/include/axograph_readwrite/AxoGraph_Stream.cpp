@@ -0,0 +1,511 @@
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Stream : write an AxoGraph X file incrementally, as samples arrive.
+
+	See also : AxoGraph_Stream.h
+
+---------------------------------------------------------------------------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "byteswap.h"
+#include "AxoGraph_Stream.h"
+
+
+// One column of the file, holding samples of one channel
+struct AGStreamSegment {
+	int32_t channel;
+	int32_t points;
+	int64_t headerPosition;		// of the column's AxoGraphXColumnHeader
+	int64_t dataPosition;		// of its first sample
+};
+
+struct AGStream {
+	AGDataRef refNum;
+	char *fileName;
+	char *partialName;			// where the columns are gathered at close
+	int32_t numberOfChannels;
+	int32_t bufferPoints;
+	int32_t columnsWritten;		// the number of columns the file header counts
+	int result;					// the first error writing the file, if any
+
+	// One column per channel, whose array is the channel's buffer and whose
+	// points are the number of samples buffered since the last flush
+	ColumnData *channels;
+
+	// The columns of the file, in order
+	AGStreamSegment *segments;
+	int32_t numberOfSegments;
+	int32_t segmentCapacity;
+};
+
+
+static const int64_t kStreamStagingBytes = 64 * 1024;
+
+
+static int64_t StreamElementBytes( const int type )
+{
+	switch ( type )
+	{
+		case ShortArrayType:
+			return sizeof( short );
+		case IntArrayType:
+			return sizeof( int32_t );
+		case FloatArrayType:
+			return sizeof( float );
+		case DoubleArrayType:
+			return sizeof( double );
+		default:
+			return 0;
+	}
+}
+
+
+static unsigned char *ChannelBuffer( const ColumnData *columnData )
+{
+	switch ( columnData->type )
+	{
+		case ShortArrayType:
+			return ( unsigned char * )columnData->shortArray;
+		case IntArrayType:
+			return ( unsigned char * )columnData->intArray;
+		case FloatArrayType:
+			return ( unsigned char * )columnData->floatArray;
+		case DoubleArrayType:
+			return ( unsigned char * )columnData->doubleArray;
+		default:
+			return NULL;
+	}
+}
+
+
+static void FreeStream( AGStream *stream )
+{
+	for ( int32_t c=0; c<stream->numberOfChannels; c++ )
+	{
+		free( stream->channels[c].title );
+		free( ChannelBuffer( &stream->channels[c] ) );
+	}
+	free( stream->channels );
+	free( stream->segments );
+	free( stream->fileName );
+	free( stream->partialName );
+	free( stream );
+}
+
+
+// Write samples in native byte order to the file, which is big-endian
+static int WriteStreamSamples( AGDataRef refNum, const unsigned char *samples, const int32_t points,
+							   const int64_t elementBytes )
+{
+#ifdef __LITTLE_ENDIAN__
+	double staging[kStreamStagingBytes / sizeof( double )];
+	int32_t chunkPoints = ( int32_t )( kStreamStagingBytes / elementBytes );
+	for ( int32_t i=0; i<points; i+=chunkPoints )
+	{
+		int32_t count = points - i < chunkPoints ? points - i : chunkPoints;
+		ByteSwapCopyArray( samples + i * elementBytes, staging, count, ( int )elementBytes );
+
+		int64_t bytes = count * elementBytes;
+		int result = WriteToFile( refNum, &bytes, staging );
+		if ( result )
+			return result;
+	}
+	return 0;
+#else
+	int64_t bytes = points * elementBytes;
+	return WriteToFile( refNum, &bytes, ( void * )samples );
+#endif
+}
+
+
+// Copy bytes, already in the file's byte order, from one file to the end of another
+static int CopyStreamBytes( AGDataRef fromRefNum, int64_t posn, int64_t bytes, AGDataRef toRefNum )
+{
+	double staging[kStreamStagingBytes / sizeof( double )];
+	while ( bytes > 0 )
+	{
+		int64_t count = bytes < kStreamStagingBytes ? bytes : kStreamStagingBytes;
+		int result = ReadFromFileAt( fromRefNum, posn, &count, staging );
+		if ( result == 0 )
+			result = WriteToFile( toRefNum, &count, staging );
+		if ( result )
+			return result;
+		posn += count;
+		bytes -= count;
+	}
+	return 0;
+}
+
+
+// Write the header and title of a channel's column, holding no samples yet,
+// at the current position
+static int StartColumn( AGDataRef refNum, const ColumnData *channel, const int32_t columnNumber,
+						int64_t *headerPosition, int64_t *dataPosition )
+{
+	int result = GetFilePosition( refNum, headerPosition );
+	if ( result )
+		return result;
+
+	ColumnData header = *channel;
+	header.points = 0;
+	result = AG_WriteColumn( refNum, kAxoGraph_X_Format, columnNumber, &header );
+	if ( result )
+		return result;
+	return GetFilePosition( refNum, dataPosition );
+}
+
+
+// Rewrite the number of points in the header of a column, leaving the
+// position just after it
+static int SetColumnPoints( AGDataRef refNum, const int64_t headerPosition, int32_t points )
+{
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapLong( &points );
+#endif
+
+	int result = SetFilePosition( refNum, headerPosition );
+	if ( result )
+		return result;
+	int64_t bytes = sizeof( int32_t );
+	return WriteToFile( refNum, &bytes, &points );
+}
+
+
+// Start a new column for a channel at the end of the file, which the file
+// header does not count until its first samples are written
+static int AddSegment( AGStream *stream, const int32_t channel )
+{
+	if ( stream->numberOfSegments == stream->segmentCapacity )
+	{
+		int32_t capacity = stream->segmentCapacity > 0 ? 2 * stream->segmentCapacity : 16;
+		AGStreamSegment *segments = ( AGStreamSegment * )realloc( stream->segments, capacity * sizeof( AGStreamSegment ) );
+		if ( segments == NULL )
+			return kAG_MemoryErr;
+		stream->segments = segments;
+		stream->segmentCapacity = capacity;
+	}
+
+	AGStreamSegment *segment = &stream->segments[stream->numberOfSegments];
+	segment->channel = channel;
+	segment->points = 0;
+	int result = StartColumn( stream->refNum, &stream->channels[channel], stream->numberOfSegments,
+							  &segment->headerPosition, &segment->dataPosition );
+	if ( result )
+		return result;
+	stream->numberOfSegments++;
+	return 0;
+}
+
+
+// Make the file header count every column
+static int CountSegments( AGStream *stream )
+{
+	if ( stream->columnsWritten == stream->numberOfSegments )
+		return 0;
+
+	// AG_WriteHeader seeks back to the start of the file to rewrite the count
+	stream->columnsWritten = stream->numberOfSegments;
+	return AG_WriteHeader( stream->refNum, kAxoGraph_X_Format, stream->columnsWritten );
+}
+
+
+// Write out a channel's buffered samples, extending the last column of the
+// file if it holds the same channel, and starting a new column otherwise
+static int WriteChannel( AGStream *stream, const int32_t channel )
+{
+	ColumnData *columnData = &stream->channels[channel];
+	AGStreamSegment *segment = NULL;
+	if ( stream->numberOfSegments > 0 )
+		segment = &stream->segments[stream->numberOfSegments - 1];
+	if ( segment == NULL || segment->channel != channel || segment->points > INT32_MAX - columnData->points )
+	{
+		int result = AddSegment( stream, channel );
+		if ( result )
+			return result;
+		segment = &stream->segments[stream->numberOfSegments - 1];
+	}
+
+	// The samples reach the operating system before the headers count them
+	int result = WriteStreamSamples( stream->refNum, ChannelBuffer( columnData ), columnData->points,
+									 StreamElementBytes( columnData->type ) );
+	if ( result == 0 )
+		result = FlushFile( stream->refNum );
+	if ( result )
+		return result;
+
+	int64_t endPosition;
+	result = GetFilePosition( stream->refNum, &endPosition );
+	if ( result )
+		return result;
+
+	segment->points += columnData->points;
+	result = SetColumnPoints( stream->refNum, segment->headerPosition, segment->points );
+	if ( result == 0 )
+		result = CountSegments( stream );
+	if ( result == 0 )
+		result = FlushFile( stream->refNum );
+	if ( result == 0 )
+		result = SetFilePosition( stream->refNum, endPosition );
+	if ( result )
+		return result;
+
+	columnData->points = 0;
+	return 0;
+}
+
+
+static int FlushChannel( AGStream *stream, const int32_t channel )
+{
+	if ( stream->result == 0 && stream->channels[channel].points > 0 )
+		stream->result = WriteChannel( stream, channel );
+	return stream->result;
+}
+
+
+// Leave exactly one column per channel, in channel order. If the columns
+// are not already laid out that way, they are gathered into the partial
+// file, and replace is set to say it should replace the stream's file.
+static int FinishStream( AGStream *stream, bool *replace )
+{
+	*replace = false;
+
+	bool inOrder = stream->numberOfSegments <= stream->numberOfChannels;
+	for ( int32_t i=0; inOrder && i<stream->numberOfSegments; i++ )
+		if ( stream->segments[i].channel != i )
+			inOrder = false;
+
+	// Only channels that never had any samples are missing: add empty columns for them
+	if ( inOrder )
+	{
+		for ( int32_t c=stream->numberOfSegments; c<stream->numberOfChannels; c++ )
+		{
+			int result = AddSegment( stream, c );
+			if ( result )
+				return result;
+		}
+		int result = CountSegments( stream );
+		if ( result == 0 )
+			result = FlushFile( stream->refNum );
+		return result;
+	}
+
+	for ( int32_t c=0; c<stream->numberOfChannels; c++ )
+	{
+		int64_t points = 0;
+		for ( int32_t i=0; i<stream->numberOfSegments; i++ )
+			if ( stream->segments[i].channel == c )
+				points += stream->segments[i].points;
+		if ( points > INT32_MAX )
+			return kAG_ShapeErr;
+	}
+
+	AGDataRef partial = NewFile( stream->partialName );
+	if ( !partial )
+		return -1;
+	*replace = true;
+
+	int result = AG_WriteHeader( partial, kAxoGraph_X_Format, stream->numberOfChannels );
+	for ( int32_t c=0; c<stream->numberOfChannels && result == 0; c++ )
+	{
+		int64_t headerPosition, dataPosition;
+		result = StartColumn( partial, &stream->channels[c], c, &headerPosition, &dataPosition );
+
+		int32_t points = 0;
+		int64_t elementBytes = StreamElementBytes( stream->channels[c].type );
+		for ( int32_t i=0; i<stream->numberOfSegments && result == 0; i++ )
+		{
+			const AGStreamSegment *segment = &stream->segments[i];
+			if ( segment->channel != c )
+				continue;
+			result = CopyStreamBytes( stream->refNum, segment->dataPosition, segment->points * elementBytes, partial );
+			points += segment->points;
+		}
+
+		int64_t endPosition;
+		if ( result == 0 )
+			result = GetFilePosition( partial, &endPosition );
+		if ( result == 0 )
+			result = SetColumnPoints( partial, headerPosition, points );
+		if ( result == 0 )
+			result = SetFilePosition( partial, endPosition );
+	}
+	if ( result == 0 )
+		result = FlushFile( partial );
+	CloseFile( partial );
+	return result;
+}
+
+
+AGStream *AG_OpenStream( const char *fileName, const int32_t numberOfChannels,
+						 const AGStreamChannel *channels, const int32_t bufferPoints, int *result )
+{
+	*result = 0;
+	if ( numberOfChannels < 0 || bufferPoints <= 0 )
+	{
+		*result = -1;
+		return NULL;
+	}
+
+	AGStream *stream = ( AGStream * )calloc( 1, sizeof( AGStream ) );
+	if ( stream == NULL )
+	{
+		*result = kAG_MemoryErr;
+		return NULL;
+	}
+	stream->channels = ( ColumnData * )calloc( numberOfChannels + 1, sizeof( ColumnData ) );
+	if ( stream->channels == NULL )
+	{
+		free( stream );
+		*result = kAG_MemoryErr;
+		return NULL;
+	}
+	stream->bufferPoints = bufferPoints;
+
+	size_t nameLength = strlen( fileName );
+	stream->fileName = ( char * )malloc( nameLength + 1 );
+	stream->partialName = ( char * )malloc( nameLength + sizeof( ".partial" ) );
+	if ( stream->fileName == NULL || stream->partialName == NULL )
+		*result = kAG_MemoryErr;
+	else
+	{
+		memcpy( stream->fileName, fileName, nameLength + 1 );
+		memcpy( stream->partialName, fileName, nameLength );
+		memcpy( stream->partialName + nameLength, ".partial", sizeof( ".partial" ) );
+	}
+
+	// Set up each channel, counting it first so that FreeStream frees
+	// whatever has been allocated if anything fails
+	for ( int32_t c=0; c<numberOfChannels && *result == 0; c++ )
+	{
+		ColumnData *columnData = &stream->channels[c];
+		stream->numberOfChannels++;
+
+		int64_t elementBytes = StreamElementBytes( channels[c].type );
+		if ( elementBytes == 0 )
+		{
+			*result = -1;
+			break;
+		}
+		columnData->type = ( ColumnType )channels[c].type;
+
+		size_t titleLength = strlen( channels[c].title );
+		columnData->titleLength = ( int32_t )( 2 * titleLength );
+		columnData->title = ( unsigned char * )malloc( titleLength + 1 );
+		void *buffer = malloc( ( size_t )( bufferPoints * elementBytes ) );
+		switch ( columnData->type )
+		{
+			case ShortArrayType:
+				columnData->shortArray = ( short * )buffer;
+				break;
+			case IntArrayType:
+				columnData->intArray = ( int * )buffer;
+				break;
+			case FloatArrayType:
+				columnData->floatArray = ( float * )buffer;
+				break;
+			default:
+				columnData->doubleArray = ( double * )buffer;
+				break;
+		}
+		if ( columnData->title == NULL || buffer == NULL )
+		{
+			*result = kAG_MemoryErr;
+			break;
+		}
+		memcpy( columnData->title, channels[c].title, titleLength + 1 );
+	}
+
+	if ( *result == 0 )
+	{
+		stream->refNum = NewFile( fileName );
+		if ( !stream->refNum )
+			*result = -1;
+	}
+	if ( *result == 0 )
+	{
+		*result = AG_WriteHeader( stream->refNum, kAxoGraph_X_Format, 0 );
+		if ( *result == 0 )
+			*result = FlushFile( stream->refNum );
+		if ( *result )
+			CloseFile( stream->refNum );
+	}
+
+	if ( *result )
+	{
+		FreeStream( stream );
+		return NULL;
+	}
+	return stream;
+}
+
+
+int AG_AppendToStream( AGStream *stream, const int32_t channel, const void *samples, const int32_t count )
+{
+	if ( channel < 0 || channel >= stream->numberOfChannels || count < 0 )
+		return -1;
+
+	ColumnData *columnData = &stream->channels[channel];
+	int64_t elementBytes = StreamElementBytes( columnData->type );
+	const unsigned char *source = ( const unsigned char * )samples;
+	int32_t remaining = count;
+
+	while ( remaining > 0 )
+	{
+		int32_t room = stream->bufferPoints - columnData->points;
+		if ( room == 0 )
+		{
+			int result = FlushChannel( stream, channel );
+			if ( result )
+				return result;
+			continue;
+		}
+
+		int32_t copied = remaining < room ? remaining : room;
+		memcpy( ChannelBuffer( columnData ) + columnData->points * elementBytes, source, ( size_t )( copied * elementBytes ) );
+		columnData->points += copied;
+		source += copied * elementBytes;
+		remaining -= copied;
+	}
+	return stream->result;
+}
+
+
+int AG_FlushStream( AGStream *stream )
+{
+	for ( int32_t c=0; c<stream->numberOfChannels; c++ )
+	{
+		int result = FlushChannel( stream, c );
+		if ( result )
+			return result;
+	}
+	return stream->result;
+}
+
+
+int AG_CloseStream( AGStream *stream )
+{
+	bool replace = false;
+	int result = AG_FlushStream( stream );
+	if ( result == 0 )
+		result = FinishStream( stream, &replace );
+	CloseFile( stream->refNum );
+
+	if ( replace )
+	{
+		if ( result == 0 )
+			result = RenameFile( stream->partialName, stream->fileName );
+		if ( result )
+			remove( stream->partialName );
+	}
+	FreeStream( stream );
+	return result;
+}
+
+
+int32_t AG_StreamColumns( const AGStream *stream )
+{
+	return stream->columnsWritten;
+}
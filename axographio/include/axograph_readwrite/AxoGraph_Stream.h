@@ -0,0 +1,78 @@
+#ifndef AXOGRAPH_STREAM_H
+#define AXOGRAPH_STREAM_H
+
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Stream : write an AxoGraph X file incrementally, as samples arrive.
+
+	See also : AxoGraph_ReadWrite.h
+
+	AG_WriteHeader needs the number of columns, and AG_WriteColumn the number of
+	points in a column, before anything is written. A stream instead collects
+	samples for a fixed set of channels in a buffer of bufferPoints samples per
+	channel, and writes a channel's samples out whenever its buffer fills, on
+	AG_FlushStream and on AG_CloseStream.
+
+	An AxoGraph X column stores its samples contiguously, after a header giving
+	their number. Samples written out for the channel held by the last column of
+	the file are appended to that column, and the number of points in its header
+	updated; samples for any other channel start a new column at the end of the
+	file, titled like the channel, and the column count in the file header is
+	updated. While a stream is open a channel may therefore span several columns,
+	but the file stays readable, up to the last flush, if the writing process
+	dies. AG_CloseStream leaves exactly one column per channel, in channel order:
+	in place if the columns are already laid out that way ( as they are for a
+	single channel ), and otherwise by copying each channel's samples into a new
+	file that then replaces the original. Memory use is bounded by the buffers.
+
+---------------------------------------------------------------------------------- */
+
+#include "fileUtils.h"
+#include "AxoGraph_ReadWrite.h"
+
+
+// One channel of a stream
+struct AGStreamChannel {
+	const char *title;		// column title, as a C string
+	int type;				// ShortArrayType, IntArrayType, FloatArrayType or DoubleArrayType
+};
+
+// An open stream; its contents are private to AxoGraph_Stream.cpp
+struct AGStream;
+
+
+AGStream *AG_OpenStream( const char *fileName, const int32_t numberOfChannels,
+						 const AGStreamChannel *channels, const int32_t bufferPoints, int *result );
+
+//	Create an AxoGraph X file for the given channels, with no columns yet, and
+//	buffers of bufferPoints samples for each channel. Returns NULL, with the
+//	error in result, if the file or the buffers could not be created.
+
+int AG_AppendToStream( AGStream *stream, const int32_t channel, const void *samples, const int32_t count );
+
+//	Append count samples, of the channel's type and in native byte order, to
+//	a channel. The samples are copied, so the caller may reuse them at once.
+//	Whenever the channel's buffer fills, its samples are written out.
+
+int AG_FlushStream( AGStream *stream );
+
+//	Write out the samples buffered for every channel since the last flush.
+//	Samples are handed to the operating system before the point count of their
+//	column, and the column count of the file, are updated, so neither ever
+//	counts samples that are not completely written. Once writing fails, the
+//	stream returns the same error from every later call.
+
+int AG_CloseStream( AGStream *stream );
+
+//	Flush the stream, gather each channel into a single column, close its file
+//	and free it. The stream is freed even if this fails, leaving the file as
+//	it was after the last successful flush. A channel of more than INT32_MAX
+//	samples cannot be held in one column, and is left in several, returning
+//	kAG_ShapeErr.
+
+int32_t AG_StreamColumns( const AGStream *stream );
+
+//	The number of columns in the file so far, which may count a channel more
+//	than once until the stream is closed.
+
+#endif
@@ -0,0 +1,401 @@
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Trailer : read and write the comment, notes and trace headers that
+	follow the last column of an AxoGraph X file.
+
+	See also : AxoGraph_Trailer.h
+
+---------------------------------------------------------------------------------- */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "stringUtils.h"
+#include "byteswap.h"
+
+#include "AxoGraph_Trailer.h"
+
+// Size of a trace header without a header version number or negative error
+// bar column, and the size of the negative error bar column number
+const int kTraceHeaderBytes = 156;
+const int kNegativeErrorBarBytes = 4;
+
+// Trace header version written by AG_WriteTrailer
+const int32_t kTraceHeaderVersion = 2;
+
+
+// Take the next big endian value from a trace header read into memory
+static int32_t TakeLong( const unsigned char **cursor )
+{
+	int32_t value;
+	memcpy( &value, *cursor, sizeof( value ) );
+	*cursor += sizeof( value );
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapLong( &value );
+#endif
+	return value;
+}
+
+static double TakeDouble( const unsigned char **cursor )
+{
+	double value;
+	memcpy( &value, *cursor, sizeof( value ) );
+	*cursor += sizeof( value );
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapDouble( &value );
+#endif
+	return value;
+}
+
+static bool TakeBool( const unsigned char **cursor )
+{
+	return TakeLong( cursor ) != 0;
+}
+
+
+static void DecodeTraceHeader( const unsigned char *bytes, const bool negativeErrorBar, AGTraceHeader *trace )
+{
+	const unsigned char *cursor = bytes;
+
+	trace->xColumn = TakeLong( &cursor );
+	trace->yColumn = TakeLong( &cursor );
+	trace->errorBarColumn = TakeLong( &cursor );
+	trace->negativeErrorBarColumn = negativeErrorBar ? TakeLong( &cursor ) : -1;
+
+	trace->group = TakeLong( &cursor );
+	trace->shown = TakeBool( &cursor );
+
+	trace->minX = TakeDouble( &cursor );
+	trace->maxX = TakeDouble( &cursor );
+	trace->minPositiveX = TakeDouble( &cursor );
+	trace->xRegularlySpaced = TakeBool( &cursor );
+	trace->xMonotonic = TakeBool( &cursor );
+	trace->xInterval = TakeDouble( &cursor );
+
+	trace->minY = TakeDouble( &cursor );
+	trace->maxY = TakeDouble( &cursor );
+	trace->minPositiveY = TakeDouble( &cursor );
+
+	trace->color = TakeLong( &cursor );
+
+	trace->lineShown = TakeBool( &cursor );
+	trace->lineThickness = TakeDouble( &cursor );
+	trace->penStyle = TakeLong( &cursor );
+
+	trace->symbolsShown = TakeBool( &cursor );
+	trace->symbolType = TakeLong( &cursor );
+	trace->symbolSize = TakeLong( &cursor );
+
+	trace->skipSymbols = TakeBool( &cursor );
+	trace->skipSymbolsByDistance = TakeBool( &cursor );
+	trace->symbolSeparation = TakeLong( &cursor );
+
+	trace->histogram = TakeBool( &cursor );
+	trace->histogramType = TakeLong( &cursor );
+	trace->histogramSeparation = TakeLong( &cursor );
+
+	trace->errorBarsShown = TakeBool( &cursor );
+	trace->positiveErrorBarShown = TakeBool( &cursor );
+	trace->negativeErrorBarShown = TakeBool( &cursor );
+	trace->errorBarWidth = TakeLong( &cursor );
+}
+
+
+static int ReadLong( const AGDataRef refNum, int32_t *value )
+{
+	int64_t bytes = sizeof( int32_t );
+	int result = ReadFromFile( refNum, &bytes, value );
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapLong( value );
+#endif
+	return result;
+}
+
+
+// Read a Unicode string of the given length in bytes as a C string;
+// a negative length is stored for a string that was never set, and a
+// length running past the end of the file is a sign of a damaged file
+static int ReadTrailerString( const AGDataRef refNum, int32_t stringBytes, unsigned char **string )
+{
+	if ( stringBytes < 0 )
+		stringBytes = 0;
+
+	if ( stringBytes > 0 )
+	{
+		int64_t posn, length;
+		int result = GetFilePosition( refNum, &posn );
+		if ( result == 0 )
+			result = GetFileLength( refNum, &length );
+		if ( result )
+			return result;
+		if ( stringBytes > length - posn )
+			return kAG_FormatErr;
+	}
+
+	*string = ( unsigned char * )malloc( ( size_t )stringBytes + 1 );
+	if ( *string == NULL )
+		return kAG_MemoryErr;
+	**string = 0;
+	if ( stringBytes == 0 )
+		return 0;
+
+	int64_t bytes = stringBytes;
+	int result = ReadFromFile( refNum, &bytes, *string );
+	if ( result == 0 )
+		UnicodeToCString( *string, stringBytes );
+	return result;
+}
+
+
+int AG_ReadTrailer( const AGDataRef refNum, const ColumnIndex *columnIndex, AGTrailer *trailer )
+{
+	memset( trailer, 0, sizeof( AGTrailer ) );
+
+	// Only AxoGraph X files have a trailer, and they may end right after the
+	// last column; otherwise the comment and notes are empty, with no traces
+	bool hasTrailer = false;
+	int32_t commentBytes = 0;
+	if ( columnIndex->fileFormat == kAxoGraph_X_Format )
+	{
+		int result = SetFilePosition( refNum, columnIndex->trailerPosition );
+		if ( result )
+			return result;
+
+		int64_t bytes = sizeof( int32_t );
+		result = ReadFromFile( refNum, &bytes, &commentBytes );
+		if ( result && bytes != 0 )
+			return result;
+		hasTrailer = ( result == 0 );
+#ifdef __LITTLE_ENDIAN__
+		ByteSwapLong( &commentBytes );
+#endif
+	}
+
+	if ( !hasTrailer )
+	{
+		int result = ReadTrailerString( refNum, 0, &trailer->comment );
+		if ( result == 0 )
+			result = ReadTrailerString( refNum, 0, &trailer->notes );
+		if ( result == 0 )
+			trailer->traces = ( AGTraceHeader * )calloc( 1, sizeof( AGTraceHeader ) );
+		return result;
+	}
+
+	int result = ReadTrailerString( refNum, commentBytes, &trailer->comment );
+	if ( result )
+		return result;
+
+	int32_t notesBytes;
+	result = ReadLong( refNum, &notesBytes );
+	if ( result )
+		return result;
+	result = ReadTrailerString( refNum, notesBytes, &trailer->notes );
+	if ( result )
+		return result;
+
+	int32_t numberOfTraces;
+	result = ReadLong( refNum, &numberOfTraces );
+	if ( result )
+		return result;
+	if ( numberOfTraces < 0 )
+		return kAG_FormatErr;
+
+	trailer->traces = ( AGTraceHeader * )calloc( numberOfTraces + 1, sizeof( AGTraceHeader ) );
+	if ( trailer->traces == NULL )
+		return kAG_MemoryErr;
+
+	// Each trace header is read with a single call, then decoded from memory
+	unsigned char header[kTraceHeaderBytes + kNegativeErrorBarBytes];
+	for ( int32_t t = 0; t < numberOfTraces; t++ )
+	{
+		bool negativeErrorBar = false;
+		if ( columnIndex->fileVersion >= 6 )
+		{
+			int32_t headerVersion;
+			result = ReadLong( refNum, &headerVersion );
+			if ( result )
+				return result;
+			if ( headerVersion < 1 || headerVersion > 2 )
+				return kAG_VersionErr;
+			negativeErrorBar = ( headerVersion >= 2 );
+		}
+
+		int64_t bytes = kTraceHeaderBytes + ( negativeErrorBar ? kNegativeErrorBarBytes : 0 );
+		result = ReadFromFile( refNum, &bytes, header );
+		if ( result )
+			return result;
+
+		DecodeTraceHeader( header, negativeErrorBar, &trailer->traces[t] );
+		trailer->numberOfTraces = t + 1;
+	}
+
+	return 0;
+}
+
+
+void AG_FreeTrailer( AGTrailer *trailer )
+{
+	free( trailer->comment );
+	free( trailer->notes );
+	free( trailer->traces );
+	trailer->comment = NULL;
+	trailer->notes = NULL;
+	trailer->traces = NULL;
+	trailer->numberOfTraces = 0;
+}
+
+
+// Put the next value into a trace header being written, in big endian order
+static void PutLong( unsigned char **cursor, int32_t value )
+{
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapLong( &value );
+#endif
+	memcpy( *cursor, &value, sizeof( value ) );
+	*cursor += sizeof( value );
+}
+
+static void PutDouble( unsigned char **cursor, double value )
+{
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapDouble( &value );
+#endif
+	memcpy( *cursor, &value, sizeof( value ) );
+	*cursor += sizeof( value );
+}
+
+static void PutBool( unsigned char **cursor, const bool value )
+{
+	PutLong( cursor, value ? 1 : 0 );
+}
+
+
+// Encode a trace header in the version 2 layout, with its header version
+static void EncodeTraceHeader( const AGTraceHeader *trace, unsigned char *bytes )
+{
+	unsigned char *cursor = bytes;
+
+	PutLong( &cursor, kTraceHeaderVersion );
+	PutLong( &cursor, trace->xColumn );
+	PutLong( &cursor, trace->yColumn );
+	PutLong( &cursor, trace->errorBarColumn );
+	PutLong( &cursor, trace->negativeErrorBarColumn );
+
+	PutLong( &cursor, trace->group );
+	PutBool( &cursor, trace->shown );
+
+	PutDouble( &cursor, trace->minX );
+	PutDouble( &cursor, trace->maxX );
+	PutDouble( &cursor, trace->minPositiveX );
+	PutBool( &cursor, trace->xRegularlySpaced );
+	PutBool( &cursor, trace->xMonotonic );
+	PutDouble( &cursor, trace->xInterval );
+
+	PutDouble( &cursor, trace->minY );
+	PutDouble( &cursor, trace->maxY );
+	PutDouble( &cursor, trace->minPositiveY );
+
+	PutLong( &cursor, trace->color );
+
+	PutBool( &cursor, trace->lineShown );
+	PutDouble( &cursor, trace->lineThickness );
+	PutLong( &cursor, trace->penStyle );
+
+	PutBool( &cursor, trace->symbolsShown );
+	PutLong( &cursor, trace->symbolType );
+	PutLong( &cursor, trace->symbolSize );
+
+	PutBool( &cursor, trace->skipSymbols );
+	PutBool( &cursor, trace->skipSymbolsByDistance );
+	PutLong( &cursor, trace->symbolSeparation );
+
+	PutBool( &cursor, trace->histogram );
+	PutLong( &cursor, trace->histogramType );
+	PutLong( &cursor, trace->histogramSeparation );
+
+	PutBool( &cursor, trace->errorBarsShown );
+	PutBool( &cursor, trace->positiveErrorBarShown );
+	PutBool( &cursor, trace->negativeErrorBarShown );
+	PutLong( &cursor, trace->errorBarWidth );
+}
+
+
+static int WriteLong( const AGDataRef refNum, int32_t value )
+{
+#ifdef __LITTLE_ENDIAN__
+	ByteSwapLong( &value );
+#endif
+	int64_t bytes = sizeof( int32_t );
+	return WriteToFile( refNum, &bytes, &value );
+}
+
+
+// Write a C string as a Unicode string, preceded by its length in bytes
+static int WriteTrailerString( const AGDataRef refNum, const unsigned char *string )
+{
+	int32_t stringLength = string != NULL ? ( int32_t )strlen( ( const char * )string ) : 0;
+	int32_t stringBytes = 2 * stringLength;
+
+	int result = WriteLong( refNum, stringBytes );
+	if ( result || stringBytes == 0 )
+		return result;
+
+	unsigned char *unicode = ( unsigned char * )malloc( stringBytes );
+	if ( unicode == NULL )
+		return kAG_MemoryErr;
+	memcpy( unicode, string, stringLength );
+	CStringToUnicode( unicode, stringBytes );
+
+	int64_t bytes = stringBytes;
+	result = WriteToFile( refNum, &bytes, unicode );
+	free( unicode );
+	return result;
+}
+
+
+void AG_InitTraceHeader( AGTraceHeader *trace, const int32_t xColumn, const int32_t yColumn, 
+						 const ColumnRange *xRange, const ColumnRange *yRange )
+{
+	memset( trace, 0, sizeof( AGTraceHeader ) );
+
+	trace->xColumn = xColumn;
+	trace->yColumn = yColumn;
+	trace->errorBarColumn = -1;
+	trace->negativeErrorBarColumn = -1;
+	trace->shown = true;
+
+	trace->minX = xRange->minimum;
+	trace->maxX = xRange->maximum;
+	trace->minPositiveX = xRange->minimumPositive;
+	trace->xRegularlySpaced = xRange->regularlySpaced;
+	trace->xMonotonic = xRange->monotonic;
+	trace->xInterval = xRange->interval;
+
+	trace->minY = yRange->minimum;
+	trace->maxY = yRange->maximum;
+	trace->minPositiveY = yRange->minimumPositive;
+
+	trace->lineShown = true;
+	trace->lineThickness = 1;
+	trace->symbolSize = 3;
+	trace->errorBarWidth = 4;
+}
+
+
+int AG_WriteTrailer( const AGDataRef refNum, const AGTrailer *trailer )
+{
+	int result = WriteTrailerString( refNum, trailer->comment );
+	if ( result == 0 )
+		result = WriteTrailerString( refNum, trailer->notes );
+	if ( result == 0 )
+		result = WriteLong( refNum, trailer->numberOfTraces );
+
+	unsigned char header[sizeof( int32_t ) + kTraceHeaderBytes + kNegativeErrorBarBytes];
+	for ( int32_t t = 0; result == 0 && t < trailer->numberOfTraces; t++ )
+	{
+		EncodeTraceHeader( &trailer->traces[t], header );
+		int64_t bytes = sizeof( header );
+		result = WriteToFile( refNum, &bytes, header );
+	}
+	return result;
+}
@@ -0,0 +1,112 @@
+#ifndef AXOGRAPH_TRAILER_H
+#define AXOGRAPH_TRAILER_H
+
+/* ----------------------------------------------------------------------------------
+
+	AxoGraph_Trailer : read and write the comment, notes and trace headers that
+	follow the last column of an AxoGraph X file.
+
+	See also : the description of the AxoGraph X format in AxoGraph_ReadWrite.h
+
+	The trailer is found from a column index, so it is read without touching any
+	column data. Only the part of the trailer described in AxoGraph_ReadWrite.h
+	is read; the display information stored after the trace headers is skipped.
+
+	Trace headers are stored without a header version number, and without a
+	negative error bar column, in files before AxoGraph X format version 6. In
+	version 6 files each starts with its header version: 1 has no negative error
+	bar column, 2 has one. They are always written in the version 6 layout, with
+	header version 2, to match the file format AG_WriteHeader writes.
+
+	AxoGraph X recalculates the ranges of a trace whose stored minimum and
+	maximum are both zero, which means scanning its data when the file is
+	loaded. Writing the trailer with the ranges found by AG_WriteColumnWithRange
+	avoids that, at no extra cost when the columns are written.
+
+---------------------------------------------------------------------------------- */
+
+#include "fileUtils.h"
+#include "AxoGraph_ReadWrite.h"
+
+
+// One trace ( a pair of X and Y columns ) and how it is displayed
+struct AGTraceHeader {
+	int32_t xColumn;
+	int32_t yColumn;
+	int32_t errorBarColumn;			// -1 if no error bars
+	int32_t negativeErrorBarColumn;	// -1 if no negative error bars
+
+	int32_t group;
+	bool shown;
+
+	double minX;					// if minX and maxX are both 0, AxoGraph recalculates them
+	double maxX;
+	double minPositiveX;			// used for log axes
+	bool xRegularlySpaced;
+	bool xMonotonic;				// each point > previous point
+	double xInterval;				// interval between points, if regularly spaced
+
+	double minY;					// if minY and maxY are both 0, AxoGraph recalculates them
+	double maxY;
+	double minPositiveY;
+
+	int32_t color;					// RGB values serialized into an int32_t
+
+	bool lineShown;
+	double lineThickness;
+	int32_t penStyle;				// 0 for solid lines, non zero for dashed
+
+	bool symbolsShown;
+	int32_t symbolType;
+	int32_t symbolSize;				// radius in pixels
+
+	bool skipSymbols;
+	bool skipSymbolsByDistance;
+	int32_t symbolSeparation;		// in pixels or points
+
+	bool histogram;
+	int32_t histogramType;			// 0 for standard solid fill
+	int32_t histogramSeparation;	// percentage of bar width
+
+	bool errorBarsShown;
+	bool positiveErrorBarShown;
+	bool negativeErrorBarShown;
+	int32_t errorBarWidth;			// in pixels
+};
+
+struct AGTrailer {
+	unsigned char *comment;			// C strings ( Latin1 ), never NULL once read
+	unsigned char *notes;
+	int32_t numberOfTraces;
+	AGTraceHeader *traces;
+};
+
+
+int AG_ReadTrailer( const AGDataRef refNum, const ColumnIndex *columnIndex, AGTrailer *trailer );
+
+//	Seek to the end of the last column listed in the column index, and read
+//	the comment, notes and trace headers stored there. Files in the older
+//	formats, and AxoGraph X files written without a trailer, give an empty
+//	comment and notes and no traces. The caller owns the strings and trace
+//	table, and must release them with AG_FreeTrailer, even after an error.
+//	Works for files opened with either OpenFile or OpenMappedFile.
+
+void AG_FreeTrailer( AGTrailer *trailer );
+
+//	Free the strings and trace headers read by AG_ReadTrailer.
+
+void AG_InitTraceHeader( AGTraceHeader *trace, const int32_t xColumn, const int32_t yColumn, 
+						 const ColumnRange *xRange, const ColumnRange *yRange );
+
+//	Set up the header of a shown trace, plotted as a plain line in the default
+//	style, for the given columns and their ranges ( as found when the columns
+//	were written by AG_WriteColumnWithRange ).
+
+int AG_WriteTrailer( const AGDataRef refNum, const AGTrailer *trailer );
+
+//	Write the comment, notes ( either of which may be NULL for an empty string )
+//	and trace headers at the current file position, which should be just past
+//	the last column of an AxoGraph X file. Returns 0 if all goes well, or the
+//	error code if one occurs.
+
+#endif
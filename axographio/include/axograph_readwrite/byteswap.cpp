@@ -3,83 +3,594 @@
 // Copyright  1996 Dr. John Clements.  All rights reserved. 
 // ******************************************************************************************
 
+#include <string.h>
+
 #include "byteswap.h"
 
+// Byte reversal of a single value, using the compiler's byte swap intrinsics where available
+#if defined(__GNUC__) || defined(__clang__)
+#define SWAP16( x ) __builtin_bswap16( x )
+#define SWAP32( x ) __builtin_bswap32( x )
+#define SWAP64( x ) __builtin_bswap64( x )
+#elif defined(_MSC_VER)
+#include <stdlib.h>
+#define SWAP16( x ) _byteswap_ushort( x )
+#define SWAP32( x ) _byteswap_ulong( x )
+#define SWAP64( x ) _byteswap_uint64( x )
+#else
+#define SWAP16( x ) ( uint16_t )( ( ( x ) >> 8 ) | ( ( x ) << 8 ) )
+#define SWAP32( x ) ( ( ( ( x ) & 0x000000FF ) << 24 ) | ( ( ( x ) & 0x0000FF00 ) << 8 ) | \
+					  ( ( ( x ) & 0x00FF0000 ) >> 8 ) | ( ( ( x ) & 0xFF000000 ) >> 24 ) )
+#define SWAP64( x ) ( ( ( uint64_t )SWAP32( ( uint32_t )( x ) ) << 32 ) | SWAP32( ( uint32_t )( ( x ) >> 32 ) ) )
+#endif
+
+// On x86 with gcc or clang, the array routines use SSSE3 or AVX2 byte shuffles
+// when the CPU running the code supports them
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) )
+#define BYTESWAP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
 void ByteSwapShort( int16_t *shortNumber )
 {
-	uint16_t *uShortNumber = ( uint16_t * )shortNumber;
-	
-	*uShortNumber = ( ( *uShortNumber >> 8 ) | ( *uShortNumber << 8 ) );
+	uint16_t value;
+	memcpy( &value, shortNumber, sizeof( value ) );
+	value = SWAP16( value );
+	memcpy( shortNumber, &value, sizeof( value ) );
 }
 
 
 void ByteSwapLong( int32_t *longNumber )
 {
-	uint32_t *uLongNumber = ( uint32_t * )longNumber;
-	
-	*uLongNumber = ( ( ( *uLongNumber & 0x000000FF )<<24 ) + ( ( *uLongNumber & 0x0000FF00 )<<8 ) +
-					 ( ( *uLongNumber & 0x00FF0000 )>>8 ) +  ( ( *uLongNumber & 0xFF000000 )>>24 ) );
+	uint32_t value;
+	memcpy( &value, longNumber, sizeof( value ) );
+	value = SWAP32( value );
+	memcpy( longNumber, &value, sizeof( value ) );
 }
 
 
 void ByteSwapFloat( float *floatNumber )
 {
-	uint32_t *uLongNumber = ( uint32_t * )floatNumber;
-	
-	*uLongNumber = ( ( ( *uLongNumber & 0x000000FF )<<24 ) + ( ( *uLongNumber & 0x0000FF00 )<<8 ) +
-					 ( ( *uLongNumber & 0x00FF0000 )>>8 ) +  ( ( *uLongNumber & 0xFF000000 )>>24 ) );
+	uint32_t value;
+	memcpy( &value, floatNumber, sizeof( value ) );
+	value = SWAP32( value );
+	memcpy( floatNumber, &value, sizeof( value ) );
 }
 
 
 void ByteSwapDouble( double *doubleNumber )
 {
-	// cast the double to an array of two unsigned ints
-	uint32_t *uLongArray = ( uint32_t * )doubleNumber;
-	
-	// swap the bytes in each int32_t
-	ByteSwapLong( ( int32_t * )&uLongArray[0] );
-	ByteSwapLong( ( int32_t * )&uLongArray[1] );
-	
-	// swap the two longs
-	uint32_t saveLong0 = uLongArray[0];
-	uLongArray[0] = uLongArray[1];
-	uLongArray[1] = saveLong0;
+	uint64_t value;
+	memcpy( &value, doubleNumber, sizeof( value ) );
+	value = SWAP64( value );
+	memcpy( doubleNumber, &value, sizeof( value ) );
 }
 
 
-void ByteSwapShortArray( int16_t *shortArray, int arraySize )
+//------------------------ Array kernels  -------------------------
+
+// Each kernel reverses the bytes of count elements of elementBytes ( 2, 4 or 8 )
+// bytes each, reading from source and writing to destination. Every block is
+// loaded before it is stored, so source and destination may be the same array.
+typedef void ( *SwapArrayKernel )( const void *source, void *destination, int32_t count, int elementBytes );
+
+static void SwapArrayScalar( const void *source, void *destination, int32_t count, int elementBytes )
 {
-	for ( int i = 0; i < arraySize; i++ )
+	const unsigned char *in = ( const unsigned char * )source;
+	unsigned char *out = ( unsigned char * )destination;
+
+	switch ( elementBytes )
 	{
-		ByteSwapShort( shortArray++ );
+		case 2:
+			for ( int32_t i = 0; i < count; i++ )
+			{
+				uint16_t value;
+				memcpy( &value, in + 2 * i, 2 );
+				value = SWAP16( value );
+				memcpy( out + 2 * i, &value, 2 );
+			}
+			break;
+		case 4:
+			for ( int32_t i = 0; i < count; i++ )
+			{
+				uint32_t value;
+				memcpy( &value, in + 4 * i, 4 );
+				value = SWAP32( value );
+				memcpy( out + 4 * i, &value, 4 );
+			}
+			break;
+		case 8:
+			for ( int32_t i = 0; i < count; i++ )
+			{
+				uint64_t value;
+				memcpy( &value, in + 8 * i, 8 );
+				value = SWAP64( value );
+				memcpy( out + 8 * i, &value, 8 );
+			}
+			break;
 	}
 }
 
 
-void ByteSwapLongArray( int32_t *longArray, int arraySize )
+#ifdef BYTESWAP_X86_KERNELS
+
+__attribute__(( target( "ssse3" ) ))
+static __m128i SwapMaskSSSE3( int elementBytes )
 {
-	for ( int i = 0; i < arraySize; i++ )
+	switch ( elementBytes )
 	{
-		ByteSwapLong( longArray++ );
+		case 2:
+			return _mm_setr_epi8( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+		case 4:
+			return _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+		default:
+			return _mm_setr_epi8( 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
 	}
 }
 
+__attribute__(( target( "ssse3" ) ))
+static void SwapArraySSSE3( const void *source, void *destination, int32_t count, int elementBytes )
+{
+	const unsigned char *in = ( const unsigned char * )source;
+	unsigned char *out = ( unsigned char * )destination;
+	const __m128i mask = SwapMaskSSSE3( elementBytes );
 
-void ByteSwapFloatArray( float *floatArray, int arraySize )
+	long bytes = ( long )count * elementBytes;
+	long i = 0;
+	for ( ; i + 16 <= bytes; i += 16 )
+	{
+		__m128i block = _mm_loadu_si128( ( const __m128i * )( in + i ) );
+		_mm_storeu_si128( ( __m128i * )( out + i ), _mm_shuffle_epi8( block, mask ) );
+	}
+
+	SwapArrayScalar( in + i, out + i, ( int32_t )( ( bytes - i ) / elementBytes ), elementBytes );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void SwapArrayAVX2( const void *source, void *destination, int32_t count, int elementBytes )
 {
-	for ( int i = 0; i < arraySize; i++ )
+	const unsigned char *in = ( const unsigned char * )source;
+	unsigned char *out = ( unsigned char * )destination;
+
+	// vpshufb shuffles within each 128 bit lane, so both lanes use the same mask
+	const __m128i laneMask = SwapMaskSSSE3( elementBytes );
+	const __m256i mask = _mm256_broadcastsi128_si256( laneMask );
+
+	long bytes = ( long )count * elementBytes;
+	long i = 0;
+	for ( ; i + 64 <= bytes; i += 64 )
+	{
+		__m256i block0 = _mm256_loadu_si256( ( const __m256i * )( in + i ) );
+		__m256i block1 = _mm256_loadu_si256( ( const __m256i * )( in + i + 32 ) );
+		_mm256_storeu_si256( ( __m256i * )( out + i ), _mm256_shuffle_epi8( block0, mask ) );
+		_mm256_storeu_si256( ( __m256i * )( out + i + 32 ), _mm256_shuffle_epi8( block1, mask ) );
+	}
+	for ( ; i + 16 <= bytes; i += 16 )
 	{
-		ByteSwapFloat( floatArray++ );
+		__m128i block = _mm_loadu_si128( ( const __m128i * )( in + i ) );
+		_mm_storeu_si128( ( __m128i * )( out + i ), _mm_shuffle_epi8( block, laneMask ) );
 	}
+
+	SwapArrayScalar( in + i, out + i, ( int32_t )( ( bytes - i ) / elementBytes ), elementBytes );
+}
+
+#endif
+
+
+// Pick the fastest kernel supported by the CPU we are running on
+static SwapArrayKernel SelectSwapArrayKernel()
+{
+#ifdef BYTESWAP_X86_KERNELS
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return SwapArrayAVX2;
+	if ( __builtin_cpu_supports( "ssse3" ) )
+		return SwapArraySSSE3;
+#endif
+	return SwapArrayScalar;
+}
+
+static void SwapArray( const void *source, void *destination, int32_t count, int elementBytes )
+{
+	static const SwapArrayKernel kernel = SelectSwapArrayKernel();
+
+	if ( count > 0 )
+		kernel( source, destination, count, elementBytes );
+}
+
+
+void ByteSwapShortArray( int16_t *shortArray, int arraySize )
+{
+	SwapArray( shortArray, shortArray, arraySize, sizeof( int16_t ) );
+}
+
+
+void ByteSwapLongArray( int32_t *longArray, int arraySize )
+{
+	SwapArray( longArray, longArray, arraySize, sizeof( int32_t ) );
+}
+
+
+void ByteSwapFloatArray( float *floatArray, int arraySize )
+{
+	SwapArray( floatArray, floatArray, arraySize, sizeof( float ) );
 }
 
 
 void ByteSwapDoubleArray( double *doubleArray, int arraySize )
 {
-	for ( int i = 0; i < arraySize; i++ )
+	SwapArray( doubleArray, doubleArray, arraySize, sizeof( double ) );
+}
+
+
+void ByteSwapCopyArray( const void *source, void *destination, int32_t arraySize, int elementBytes )
+{
+	SwapArray( source, destination, arraySize, elementBytes );
+}
+
+
+//------------------------ Convert kernels  -------------------------
+
+// Load a value stored in file ( big-endian ) byte order from unaligned memory
+static inline uint16_t LoadFileShort( const unsigned char *bytes )
+{
+	uint16_t value;
+	memcpy( &value, bytes, sizeof( value ) );
+#ifdef __LITTLE_ENDIAN__
+	value = SWAP16( value );
+#endif
+	return value;
+}
+
+static inline uint32_t LoadFileLong( const unsigned char *bytes )
+{
+	uint32_t value;
+	memcpy( &value, bytes, sizeof( value ) );
+#ifdef __LITTLE_ENDIAN__
+	value = SWAP32( value );
+#endif
+	return value;
+}
+
+static inline uint64_t LoadFileLongLong( const unsigned char *bytes )
+{
+	uint64_t value;
+	memcpy( &value, bytes, sizeof( value ) );
+#ifdef __LITTLE_ENDIAN__
+	value = SWAP64( value );
+#endif
+	return value;
+}
+
+
+// The int16_t kernels write to floatOut, or to doubleOut if floatOut is NULL.
+// All of them compute in double precision, as value * scale + offset, so the
+// vector and scalar kernels give identical results.
+typedef void ( *ConvertShortKernel )( const unsigned char *in, int32_t count, double scale, double offset, 
+									  float *floatOut, double *doubleOut );
+
+static void ConvertShortsScalar( const unsigned char *in, int32_t count, double scale, double offset, 
+								 float *floatOut, double *doubleOut )
+{
+	if ( floatOut != NULL )
+	{
+		for ( int32_t i = 0; i < count; i++ )
+			floatOut[i] = ( int16_t )LoadFileShort( in + 2 * i ) * scale + offset;
+	}
+	else
+	{
+		for ( int32_t i = 0; i < count; i++ )
+			doubleOut[i] = ( int16_t )LoadFileShort( in + 2 * i ) * scale + offset;
+	}
+}
+
+
+#ifdef BYTESWAP_X86_KERNELS
+
+__attribute__(( target( "avx2" ) ))
+static void ConvertShortsAVX2( const unsigned char *in, int32_t count, double scale, double offset, 
+							   float *floatOut, double *doubleOut )
+{
+	const __m128i mask = SwapMaskSSSE3( 2 );
+	const __m256d scales = _mm256_set1_pd( scale );
+	const __m256d offsets = _mm256_set1_pd( offset );
+
+	// eight samples per pass: swap, widen to int32_t, then convert each half to double
+	int32_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
+	{
+		__m128i shorts = _mm_shuffle_epi8( _mm_loadu_si128( ( const __m128i * )( in + 2 * i ) ), mask );
+		__m256i longs = _mm256_cvtepi16_epi32( shorts );
+		__m256d low = _mm256_cvtepi32_pd( _mm256_castsi256_si128( longs ) );
+		__m256d high = _mm256_cvtepi32_pd( _mm256_extracti128_si256( longs, 1 ) );
+		low = _mm256_add_pd( _mm256_mul_pd( low, scales ), offsets );
+		high = _mm256_add_pd( _mm256_mul_pd( high, scales ), offsets );
+
+		if ( floatOut != NULL )
+		{
+			_mm_storeu_ps( floatOut + i, _mm256_cvtpd_ps( low ) );
+			_mm_storeu_ps( floatOut + i + 4, _mm256_cvtpd_ps( high ) );
+		}
+		else
+		{
+			_mm256_storeu_pd( doubleOut + i, low );
+			_mm256_storeu_pd( doubleOut + i + 4, high );
+		}
+	}
+
+	ConvertShortsScalar( in + 2 * i, count - i, scale, offset, 
+						 floatOut != NULL ? floatOut + i : NULL, doubleOut != NULL ? doubleOut + i : NULL );
+}
+
+#endif
+
+
+static ConvertShortKernel SelectConvertShortKernel()
+{
+#ifdef BYTESWAP_X86_KERNELS
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return ConvertShortsAVX2;
+#endif
+	return ConvertShortsScalar;
+}
+
+static void ConvertShorts( const void *source, int32_t count, double scale, double offset, 
+						   float *floatOut, double *doubleOut )
+{
+	static const ConvertShortKernel kernel = SelectConvertShortKernel();
+
+	if ( count > 0 )
+		kernel( ( const unsigned char * )source, count, scale, offset, floatOut, doubleOut );
+}
+
+
+void ConvertShortArrayToFloat( const void *shortArray, int32_t arraySize, double scale, double offset, float *floatArray )
+{
+	ConvertShorts( shortArray, arraySize, scale, offset, floatArray, NULL );
+}
+
+
+void ConvertShortArrayToDouble( const void *shortArray, int32_t arraySize, double scale, double offset, double *doubleArray )
+{
+	ConvertShorts( shortArray, arraySize, scale, offset, NULL, doubleArray );
+}
+
+
+// The wide kernels convert arrays of 4 and 8 byte values of one of these types
+enum WideSourceType { kWideLong, kWideFloat, kWideDouble };
+
+// Like the int16_t kernels, these write to floatOut, or to doubleOut if
+// floatOut is NULL. The vector kernels round int32_t and double values to
+// float to nearest, as the scalar casts do, and widening is exact, so all
+// of them give identical results.
+typedef void ( *ConvertWideKernel )( const unsigned char *in, int32_t count, int sourceType, 
+									 float *floatOut, double *doubleOut );
+
+static inline float LoadFileFloat( const unsigned char *bytes )
+{
+	uint32_t bits = LoadFileLong( bytes );
+	float value;
+	memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+static inline double LoadFileDouble( const unsigned char *bytes )
+{
+	uint64_t bits = LoadFileLongLong( bytes );
+	double value;
+	memcpy( &value, &bits, sizeof( value ) );
+	return value;
+}
+
+static void ConvertWideScalar( const unsigned char *in, int32_t count, int sourceType, 
+							   float *floatOut, double *doubleOut )
+{
+	switch ( sourceType )
+	{
+		case kWideLong:
+			if ( floatOut != NULL )
+				for ( int32_t i = 0; i < count; i++ )
+					floatOut[i] = ( float )( int32_t )LoadFileLong( in + 4 * i );
+			else
+				for ( int32_t i = 0; i < count; i++ )
+					doubleOut[i] = ( int32_t )LoadFileLong( in + 4 * i );
+			break;
+		case kWideFloat:
+			if ( floatOut != NULL )
+				for ( int32_t i = 0; i < count; i++ )
+					floatOut[i] = LoadFileFloat( in + 4 * i );
+			else
+				for ( int32_t i = 0; i < count; i++ )
+					doubleOut[i] = LoadFileFloat( in + 4 * i );
+			break;
+		case kWideDouble:
+			if ( floatOut != NULL )
+				for ( int32_t i = 0; i < count; i++ )
+					floatOut[i] = ( float )LoadFileDouble( in + 8 * i );
+			else
+				for ( int32_t i = 0; i < count; i++ )
+					doubleOut[i] = LoadFileDouble( in + 8 * i );
+			break;
+	}
+}
+
+
+#ifdef BYTESWAP_X86_KERNELS
+
+__attribute__(( target( "ssse3" ) ))
+static void ConvertWideSSSE3( const unsigned char *in, int32_t count, int sourceType, 
+							  float *floatOut, double *doubleOut )
+{
+	const __m128i mask4 = SwapMaskSSSE3( 4 );
+	const __m128i mask8 = SwapMaskSSSE3( 8 );
+
+	// four samples per pass: swap, then convert or widen
+	int32_t i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		if ( sourceType == kWideDouble )
+		{
+			__m128i low = _mm_shuffle_epi8( _mm_loadu_si128( ( const __m128i * )( in + 8 * i ) ), mask8 );
+			__m128i high = _mm_shuffle_epi8( _mm_loadu_si128( ( const __m128i * )( in + 8 * i + 16 ) ), mask8 );
+			if ( floatOut != NULL )
+				_mm_storeu_ps( floatOut + i, _mm_movelh_ps( _mm_cvtpd_ps( _mm_castsi128_pd( low ) ), 
+															_mm_cvtpd_ps( _mm_castsi128_pd( high ) ) ) );
+			else
+			{
+				_mm_storeu_pd( doubleOut + i, _mm_castsi128_pd( low ) );
+				_mm_storeu_pd( doubleOut + i + 2, _mm_castsi128_pd( high ) );
+			}
+			continue;
+		}
+
+		__m128i values = _mm_shuffle_epi8( _mm_loadu_si128( ( const __m128i * )( in + 4 * i ) ), mask4 );
+		if ( sourceType == kWideLong )
+		{
+			if ( floatOut != NULL )
+				_mm_storeu_ps( floatOut + i, _mm_cvtepi32_ps( values ) );
+			else
+			{
+				_mm_storeu_pd( doubleOut + i, _mm_cvtepi32_pd( values ) );
+				_mm_storeu_pd( doubleOut + i + 2, _mm_cvtepi32_pd( _mm_srli_si128( values, 8 ) ) );
+			}
+		}
+		else
+		{
+			__m128 floats = _mm_castsi128_ps( values );
+			if ( floatOut != NULL )
+				_mm_storeu_ps( floatOut + i, floats );
+			else
+			{
+				_mm_storeu_pd( doubleOut + i, _mm_cvtps_pd( floats ) );
+				_mm_storeu_pd( doubleOut + i + 2, _mm_cvtps_pd( _mm_movehl_ps( floats, floats ) ) );
+			}
+		}
+	}
+
+	ConvertWideScalar( in + ( sourceType == kWideDouble ? 8 : 4 ) * i, count - i, sourceType, 
+					   floatOut != NULL ? floatOut + i : NULL, doubleOut != NULL ? doubleOut + i : NULL );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void ConvertWideAVX2( const unsigned char *in, int32_t count, int sourceType, 
+							 float *floatOut, double *doubleOut )
+{
+	const __m256i mask4 = _mm256_broadcastsi128_si256( SwapMaskSSSE3( 4 ) );
+	const __m256i mask8 = _mm256_broadcastsi128_si256( SwapMaskSSSE3( 8 ) );
+
+	// eight samples per pass: swap, then convert or widen each half
+	int32_t i = 0;
+	for ( ; i + 8 <= count; i += 8 )
 	{
-		ByteSwapDouble( doubleArray++ );
+		if ( sourceType == kWideDouble )
+		{
+			__m256i low = _mm256_shuffle_epi8( _mm256_loadu_si256( ( const __m256i * )( in + 8 * i ) ), mask8 );
+			__m256i high = _mm256_shuffle_epi8( _mm256_loadu_si256( ( const __m256i * )( in + 8 * i + 32 ) ), mask8 );
+			if ( floatOut != NULL )
+			{
+				_mm_storeu_ps( floatOut + i, _mm256_cvtpd_ps( _mm256_castsi256_pd( low ) ) );
+				_mm_storeu_ps( floatOut + i + 4, _mm256_cvtpd_ps( _mm256_castsi256_pd( high ) ) );
+			}
+			else
+			{
+				_mm256_storeu_pd( doubleOut + i, _mm256_castsi256_pd( low ) );
+				_mm256_storeu_pd( doubleOut + i + 4, _mm256_castsi256_pd( high ) );
+			}
+			continue;
+		}
+
+		__m256i values = _mm256_shuffle_epi8( _mm256_loadu_si256( ( const __m256i * )( in + 4 * i ) ), mask4 );
+		if ( sourceType == kWideLong )
+		{
+			if ( floatOut != NULL )
+				_mm256_storeu_ps( floatOut + i, _mm256_cvtepi32_ps( values ) );
+			else
+			{
+				_mm256_storeu_pd( doubleOut + i, _mm256_cvtepi32_pd( _mm256_castsi256_si128( values ) ) );
+				_mm256_storeu_pd( doubleOut + i + 4, _mm256_cvtepi32_pd( _mm256_extracti128_si256( values, 1 ) ) );
+			}
+		}
+		else
+		{
+			__m256 floats = _mm256_castsi256_ps( values );
+			if ( floatOut != NULL )
+				_mm256_storeu_ps( floatOut + i, floats );
+			else
+			{
+				_mm256_storeu_pd( doubleOut + i, _mm256_cvtps_pd( _mm256_castps256_ps128( floats ) ) );
+				_mm256_storeu_pd( doubleOut + i + 4, _mm256_cvtps_pd( _mm256_extractf128_ps( floats, 1 ) ) );
+			}
+		}
 	}
+
+	ConvertWideScalar( in + ( sourceType == kWideDouble ? 8 : 4 ) * i, count - i, sourceType, 
+					   floatOut != NULL ? floatOut + i : NULL, doubleOut != NULL ? doubleOut + i : NULL );
+}
+
+#endif
+
+
+static ConvertWideKernel SelectConvertWideKernel()
+{
+#ifdef BYTESWAP_X86_KERNELS
+	if ( __builtin_cpu_supports( "avx2" ) )
+		return ConvertWideAVX2;
+	if ( __builtin_cpu_supports( "ssse3" ) )
+		return ConvertWideSSSE3;
+#endif
+	return ConvertWideScalar;
+}
+
+static void ConvertWide( const void *source, int32_t count, int sourceType, float *floatOut, double *doubleOut )
+{
+	static const ConvertWideKernel kernel = SelectConvertWideKernel();
+
+	if ( count > 0 )
+		kernel( ( const unsigned char * )source, count, sourceType, floatOut, doubleOut );
+}
+
+
+void ConvertLongArrayToFloat( const void *longArray, int32_t arraySize, float *floatArray )
+{
+	ConvertWide( longArray, arraySize, kWideLong, floatArray, NULL );
+}
+
+
+void ConvertLongArrayToDouble( const void *longArray, int32_t arraySize, double *doubleArray )
+{
+	ConvertWide( longArray, arraySize, kWideLong, NULL, doubleArray );
+}
+
+
+void ConvertFloatArrayToFloat( const void *floatArray, int32_t arraySize, float *floatArrayOut )
+{
+#ifdef __LITTLE_ENDIAN__
+	SwapArray( floatArray, floatArrayOut, arraySize, sizeof( float ) );
+#else
+	memmove( floatArrayOut, floatArray, arraySize * sizeof( float ) );
+#endif
+}
+
+
+void ConvertFloatArrayToDouble( const void *floatArray, int32_t arraySize, double *doubleArray )
+{
+	ConvertWide( floatArray, arraySize, kWideFloat, NULL, doubleArray );
+}
+
+
+void ConvertDoubleArrayToFloat( const void *doubleArray, int32_t arraySize, float *floatArray )
+{
+	ConvertWide( doubleArray, arraySize, kWideDouble, floatArray, NULL );
+}
+
+
+void ConvertDoubleArrayToDouble( const void *doubleArray, int32_t arraySize, double *doubleArrayOut )
+{
+#ifdef __LITTLE_ENDIAN__
+	SwapArray( doubleArray, doubleArrayOut, arraySize, sizeof( double ) );
+#else
+	memmove( doubleArrayOut, doubleArray, arraySize * sizeof( double ) );
+#endif
 }
 
 
@@ -30,5 +30,33 @@ void ByteSwapFloatArray( float *floatArray, int32_t arraySize );
 // swap bytes in a double (8 byte) array
 void ByteSwapDoubleArray( double *doubleArray, int32_t arraySize );
 
+// copy an array of arraySize elements of elementBytes ( 2, 4, or 8 ) bytes each,
+// swapping the byte order of each element; the source is not modified
+void ByteSwapCopyArray( const void *source, void *destination, int32_t arraySize, int elementBytes );
+
+
+//------------------------ Convert Routines  -------------------------
+
+// These read an array stored in AxoGraph file byte order (big-endian), which
+// need not be aligned, and write native floating point values, byte swapping
+// and converting in a single pass ( with SSSE3 or AVX2 kernels on x86, when
+// the CPU running the code supports them ).
+
+// convert a int16_t (2 byte) array to shortArray[i] * scale + offset
+void ConvertShortArrayToFloat( const void *shortArray, int32_t arraySize, double scale, double offset, float *floatArray );
+void ConvertShortArrayToDouble( const void *shortArray, int32_t arraySize, double scale, double offset, double *doubleArray );
+
+// convert an int32_t (4 byte) array
+void ConvertLongArrayToFloat( const void *longArray, int32_t arraySize, float *floatArray );
+void ConvertLongArrayToDouble( const void *longArray, int32_t arraySize, double *doubleArray );
+
+// convert a float (4 byte) array
+void ConvertFloatArrayToFloat( const void *floatArray, int32_t arraySize, float *floatArrayOut );
+void ConvertFloatArrayToDouble( const void *floatArray, int32_t arraySize, double *doubleArray );
+
+// convert a double (8 byte) array
+void ConvertDoubleArrayToFloat( const void *doubleArray, int32_t arraySize, float *floatArray );
+void ConvertDoubleArrayToDouble( const void *doubleArray, int32_t arraySize, double *doubleArrayOut );
+
 
 #endif
@@ -39,6 +39,8 @@ typedef __int16 int16_t;
 typedef __int32 int32_t;
 typedef unsigned __int16 uint16_t;
 typedef unsigned __int32 uint32_t;
+typedef __int64 int64_t;
+typedef unsigned __int64 uint64_t;
 #else
 // most everything else complies with the C99 standard, so we can use the types defined in the standard
 #include <stdint.h>
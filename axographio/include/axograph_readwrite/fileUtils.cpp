@@ -1,4 +1,7 @@
 
+// Use a 64-bit off_t for fseeko and ftello, even on 32-bit systems
+#define _FILE_OFFSET_BITS 64
+
 // If we're running on a mac and are willing to link to the carbon framework,
 // we can use Carbon's file APIs so the file type will be set correctly.  
 #if defined(__APPLE__) && !defined(NO_CARBON)
@@ -158,20 +161,107 @@ int NewFile( const char *fileName )
 }
 
 
-int SetFilePosition( int dataRefNum, int posn )
+// The Carbon file manager only handles 32-bit positions and counts
+int SetFilePosition( int dataRefNum, int64_t posn )
+{
+	if ( posn > 0x7FFFFFFF )
+		return paramErr;
+	return SetFPos( dataRefNum, fsFromStart, ( long )posn );		// Position the mark 
+}
+
+
+int GetFilePosition( int dataRefNum, int64_t *posn )
+{
+	long macPosn = 0;
+	int result = GetFPos( dataRefNum, &macPosn );
+	*posn = macPosn;
+	return result;
+}
+
+
+int GetFileLength( int dataRefNum, int64_t *length )
+{
+	long macLength = 0;
+	int result = GetEOF( dataRefNum, &macLength );
+	*length = macLength;
+	return result;
+}
+
+
+int ReadFromFile( int dataRefNum, int64_t *count, void *dataToRead )
+{
+	if ( *count > 0x7FFFFFFF )
+		return paramErr;
+	long macCount = ( long )*count;
+	int result = FSRead( dataRefNum, &macCount, dataToRead );
+	*count = macCount;
+	return result;
+}
+
+int WriteToFile( int dataRefNum, int64_t *count, void *dataToWrite )
+{
+	if ( *count > 0x7FFFFFFF )
+		return paramErr;
+	long macCount = ( long )*count;
+	int result = FSWrite( dataRefNum, &macCount, dataToWrite );
+	*count = macCount;
+	return result;
+}
+
+int FlushFile( int dataRefNum )
+{
+	return FSFlushFork( dataRefNum );
+}
+
+int RenameFile( const char *fromName, const char *toName )
+{
+	return rename( fromName, toName );
+}
+
+
+// Memory mapping is not supported through the Carbon file APIs
+int OpenMappedFile( const char *fileName )
+{
+	return 0;
+}
+
+int MapFromFile( int dataRefNum, int64_t *count, const void **dataPointer )
+{
+	*count = 0;
+	*dataPointer = NULL;
+	return paramErr;
+}
+
+
+// Nor are positioned reads, so they seek and share the file position
+int OpenPositionedFile( const char *fileName )
 {
-	return SetFPos( dataRefNum, fsFromStart, posn );		// Position the mark 
+	return OpenFile( fileName );
 }
 
+int ReadFromFileAt( int dataRefNum, int64_t posn, int64_t *count, void *dataToRead )
+{
+	int result = SetFilePosition( dataRefNum, posn );
+	if ( result )
+	{
+		*count = 0;
+		return result;
+	}
+	return ReadFromFile( dataRefNum, count, dataToRead );
+}
 
-int ReadFromFile( int dataRefNum, long *count, void *dataToRead )
+int MapFromFileAt( int dataRefNum, int64_t posn, int64_t *count, const void **dataPointer )
 {
-	return FSRead( dataRefNum, count, dataToRead );
+	return MapFromFile( dataRefNum, count, dataPointer );
 }
 
-int WriteToFile( int dataRefNum, long *count, void *dataToWrite )
+
+// Nor are files held in memory, so they are all opened the usual way
+void ReadWholeFiles( const char * const *fileNames, int32_t numberOfFiles, int64_t maxBytes, bool useRing,
+					 AGDataRef *wholeFiles )
 {
-	return FSWrite( dataRefNum, count, dataToWrite );
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+		wholeFiles[i] = 0;
 }
 
 
@@ -186,41 +276,789 @@ int WriteToFile( int dataRefNum, long *count, void *dataToWrite )
 
 #include "fileUtils.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// io_uring is used through its system calls, so it needs only the kernel
+// headers; the operations used here need those of Linux 5.6 or later.
+// Define AG_NO_IO_URING to always read whole files with pread instead.
+#if defined(__linux__) && defined(__has_include) && !defined(AG_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#ifdef IORING_FEAT_RW_CUR_POS
+#define AG_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+// An AGDataRef points to one of these.  Files opened with OpenFile or NewFile
+// go through stdio; files opened with OpenMappedFile or OpenPositionedFile, or
+// read by ReadWholeFiles, have no stream and keep their own position, within
+// the mapping ( or the copy of the file in memory ) or the file.
+struct AGFile
+{
+	FILE *stream;
+	const unsigned char *map;
+	int64_t mapSize;
+	bool inMemory;		// map was allocated with malloc rather than mapped
+	int64_t posn;
+#ifdef _WIN32
+	HANDLE handle;		// INVALID_HANDLE_VALUE unless opened with OpenPositionedFile
+#else
+	int fd;				// -1 unless opened with OpenPositionedFile
+#endif
+};
+
+static bool IsPositionedFile( const AGFile *file )
+{
+#ifdef _WIN32
+	return file->handle != INVALID_HANDLE_VALUE;
+#else
+	return file->fd >= 0;
+#endif
+}
+
+static void ClearPositionedFile( AGFile *file )
+{
+#ifdef _WIN32
+	file->handle = INVALID_HANDLE_VALUE;
+#else
+	file->fd = -1;
+#endif
+}
+
+static AGDataRef NewFileRef( FILE *stream )
+{
+	if ( stream == NULL )
+		return NULL;
+	
+	AGFile *file = ( AGFile * )malloc( sizeof( AGFile ) );
+	if ( file == NULL )
+	{
+		fclose( stream );
+		return NULL;
+	}
+	
+	file->stream = stream;
+	file->map = NULL;
+	file->mapSize = 0;
+	file->inMemory = false;
+	file->posn = 0;
+	ClearPositionedFile( file );
+	return file;
+}
+
+// Map the whole file read-only; returns NULL in *map for an empty file
+static int MapWholeFile( const char *fileName, const unsigned char **map, int64_t *mapSize )
+{
+	*map = NULL;
+	*mapSize = 0;
+	
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+									 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( fileHandle == INVALID_HANDLE_VALUE )
+		return -1;
+	
+	LARGE_INTEGER size;
+	if ( !GetFileSizeEx( fileHandle, &size ) || ( uint64_t )size.QuadPart > ( SIZE_T )-1 )
+	{
+		CloseHandle( fileHandle );
+		return -1;
+	}
+	
+	if ( size.QuadPart > 0 )
+	{
+		// the view keeps the mapping alive, so both handles can be closed
+		HANDLE mapHandle = CreateFileMappingA( fileHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( mapHandle != NULL )
+		{
+			*map = ( const unsigned char * )MapViewOfFile( mapHandle, FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( mapHandle );
+		}
+		if ( *map == NULL )
+		{
+			CloseHandle( fileHandle );
+			return -1;
+		}
+	}
+	CloseHandle( fileHandle );
+	*mapSize = size.QuadPart;
+#else
+	int fd = open( fileName, O_RDONLY );
+	if ( fd < 0 )
+		return -1;
+	
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 || ( uint64_t )info.st_size > ( size_t )-1 )
+	{
+		close( fd );
+		return -1;
+	}
+	
+	if ( info.st_size > 0 )
+	{
+		// the mapping outlives the descriptor, so it can be closed right away
+		void *mapping = mmap( NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+		if ( mapping == MAP_FAILED )
+		{
+			close( fd );
+			return -1;
+		}
+		*map = ( const unsigned char * )mapping;
+	}
+	close( fd );
+	*mapSize = info.st_size;
+#endif
+	
+	return 0;
+}
 
 AGDataRef OpenFile( const char *fileName )
 {
-	return fopen(fileName, "rb");
+	return NewFileRef( fopen(fileName, "rb") );
+}
+
+AGDataRef OpenMappedFile( const char *fileName )
+{
+	AGFile *file = ( AGFile * )malloc( sizeof( AGFile ) );
+	if ( file == NULL )
+		return NULL;
+	
+	if ( MapWholeFile( fileName, &file->map, &file->mapSize ) )
+	{
+		free( file );
+		return NULL;
+	}
+	
+	file->stream = NULL;
+	file->inMemory = false;
+	file->posn = 0;
+	ClearPositionedFile( file );
+	return file;
+}
+
+AGDataRef OpenPositionedFile( const char *fileName )
+{
+	AGFile *file = ( AGFile * )malloc( sizeof( AGFile ) );
+	if ( file == NULL )
+		return NULL;
+	
+#ifdef _WIN32
+	file->handle = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+								OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+#else
+	file->fd = open( fileName, O_RDONLY );
+#endif
+	if ( !IsPositionedFile( file ) )
+	{
+		free( file );
+		return NULL;
+	}
+	
+	file->stream = NULL;
+	file->map = NULL;
+	file->mapSize = 0;
+	file->inMemory = false;
+	file->posn = 0;
+	return file;
+}
+
+// Read up to *count bytes at posn from a positioned file, retrying short reads
+static int ReadPositioned( const AGFile *file, int64_t posn, int64_t *count, void *dataToRead )
+{
+	int64_t goal = *count;
+	unsigned char *destination = ( unsigned char * )dataToRead;
+	
+	*count = 0;
+	if ( posn < 0 )
+		return -1;
+	while ( *count < goal )
+	{
+		int64_t remaining = goal - *count;
+#ifdef _WIN32
+		// an explicit offset makes ReadFile ignore the handle's file pointer
+		OVERLAPPED overlapped;
+		memset( &overlapped, 0, sizeof( overlapped ) );
+		overlapped.Offset = ( DWORD )( posn + *count );
+		overlapped.OffsetHigh = ( DWORD )( ( posn + *count ) >> 32 );
+		DWORD bytesRead = 0;
+		DWORD request = remaining > 0x40000000 ? 0x40000000 : ( DWORD )remaining;
+		if ( !ReadFile( file->handle, destination + *count, request, &bytesRead, &overlapped ) )
+			break;
+		int64_t got = bytesRead;
+#else
+		size_t request = remaining > 0x40000000 ? 0x40000000 : ( size_t )remaining;
+		ssize_t got = pread( file->fd, destination + *count, request, ( off_t )( posn + *count ) );
+		if ( got < 0 && errno == EINTR )
+			continue;
+		if ( got < 0 )
+			break;
+#endif
+		if ( got == 0 )
+			break;
+		*count += got;
+	}
+	return *count != goal;
 }
 
 void CloseFile( AGDataRef dataRefNum )
 {
-	fclose((FILE*)(dataRefNum));
+	AGFile *file = ( AGFile * )dataRefNum;
+	
+	if ( file->stream != NULL )
+		fclose( file->stream );
+	else if ( IsPositionedFile( file ) )
+	{
+#ifdef _WIN32
+		CloseHandle( file->handle );
+#else
+		close( file->fd );
+#endif
+	}
+	else if ( file->inMemory )
+		free( ( void * )file->map );
+	else if ( file->map != NULL )
+	{
+#ifdef _WIN32
+		UnmapViewOfFile( file->map );
+#else
+		munmap( ( void * )file->map, ( size_t )file->mapSize );
+#endif
+	}
+	free( file );
 }
 
 AGDataRef NewFile( const char *fileName )
 {
-	return fopen(fileName, "wb+");
+	return NewFileRef( fopen(fileName, "wb+") );
+}
+
+int SetFilePosition( AGDataRef dataRefNum, int64_t posn )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	
+	if ( file->stream != NULL )
+#ifdef _WIN32
+		return _fseeki64(file->stream, posn, SEEK_SET);
+#else
+		return fseeko(file->stream, ( off_t )posn, SEEK_SET);
+#endif
+	
+	if ( posn < 0 )
+		return -1;
+	file->posn = posn;
+	return 0;
+}
+
+int GetFilePosition( AGDataRef dataRefNum, int64_t *posn )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	
+	if ( file->stream != NULL )
+#ifdef _WIN32
+		*posn = _ftelli64(file->stream);
+#else
+		*posn = ftello(file->stream);
+#endif
+	else
+		*posn = file->posn;
+	return *posn < 0;
+}
+
+int GetFileLength( AGDataRef dataRefNum, int64_t *length )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	
+	if ( file->stream != NULL )
+	{
+		// seek to the end and back, which also counts anything still buffered
+		int64_t posn;
+		int result = GetFilePosition( dataRefNum, &posn );
+		if ( result )
+			return result;
+#ifdef _WIN32
+		result = _fseeki64(file->stream, 0, SEEK_END);
+		*length = _ftelli64(file->stream);
+#else
+		result = fseeko(file->stream, 0, SEEK_END);
+		*length = ftello(file->stream);
+#endif
+		if ( result == 0 && *length < 0 )
+			result = -1;
+		int restored = SetFilePosition( dataRefNum, posn );
+		return result ? result : restored;
+	}
+	
+	if ( IsPositionedFile( file ) )
+	{
+#ifdef _WIN32
+		LARGE_INTEGER size;
+		if ( !GetFileSizeEx( file->handle, &size ) )
+			return -1;
+		*length = size.QuadPart;
+#else
+		struct stat info;
+		if ( fstat( file->fd, &info ) != 0 )
+			return -1;
+		*length = info.st_size;
+#endif
+		return 0;
+	}
+	
+	*length = file->mapSize;
+	return 0;
 }
 
-int SetFilePosition( AGDataRef dataRefNum, int posn )
+int ReadFromFile( AGDataRef dataRefNum, int64_t *count, void *dataToRead )
 {
-	return fseek((FILE*)(dataRefNum), posn, SEEK_SET);
+	AGFile *file = ( AGFile * )dataRefNum;
+	int64_t goal = *count;
+
+	if ( file->stream != NULL )
+		(*count) = (int64_t)fread(dataToRead, 1, (size_t)*count, file->stream); 
+	else if ( IsPositionedFile( file ) )
+	{
+		ReadPositioned( file, file->posn, count, dataToRead );
+		file->posn += *count;
+	}
+	else
+	{
+		const void *mapped;
+		MapFromFile( dataRefNum, count, &mapped );
+		if ( *count > 0 )
+			memcpy( dataToRead, mapped, (size_t)*count );
+	}
+	return *count != goal;
 }
 
-int ReadFromFile( AGDataRef dataRefNum, long *count, void *dataToRead )
+int WriteToFile( AGDataRef dataRefNum, int64_t *count, void *dataToWrite )
 {
-	long goal = *count;
+	AGFile *file = ( AGFile * )dataRefNum;
+	int64_t goal = *count;
 
-	(*count) = (long)fread(dataToRead, 1, *count, (FILE*)(dataRefNum)); 
+	// mapped files are read-only
+	if ( file->stream == NULL )
+		(*count) = 0;
+	else
+		(*count) = (int64_t)fwrite(dataToWrite, 1, (size_t)*count, file->stream);
 	return *count != goal;
 }
 
-int WriteToFile( AGDataRef dataRefNum, long *count, void *dataToWrite )
+int FlushFile( AGDataRef dataRefNum )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	
+	// mapped files are read-only, so there is never anything to flush
+	if ( file->stream == NULL )
+		return 0;
+	return fflush( file->stream );
+}
+
+int RenameFile( const char *fromName, const char *toName )
 {
-	long goal = *count;
+#ifdef _WIN32
+	// rename will not replace an existing file on Windows
+	return !MoveFileExA( fromName, toName, MOVEFILE_REPLACE_EXISTING );
+#else
+	return rename( fromName, toName );
+#endif
+}
+
+int MapFromFile( AGDataRef dataRefNum, int64_t *count, const void **dataPointer )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	int result = MapFromFileAt( dataRefNum, file->posn, count, dataPointer );
+	file->posn += *count;
+	return result;
+}
+
+int MapFromFileAt( AGDataRef dataRefNum, int64_t posn, int64_t *count, const void **dataPointer )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	int64_t goal = *count;
+	
+	*dataPointer = NULL;
+	if ( file->stream != NULL || IsPositionedFile( file ) || posn < 0 )
+	{
+		*count = 0;
+		return -1;
+	}
+	
+	int64_t remaining = file->mapSize - posn;
+	if ( remaining < 0 )
+		remaining = 0;
+	if ( *count > remaining )
+		*count = remaining;
+	if ( *count < 0 )
+		*count = 0;
+	
+	*dataPointer = file->map + ( remaining > 0 ? posn : file->mapSize );
+	return *count != goal;
+}
 
-	(*count) = (long)fwrite(dataToWrite, 1, *count, (FILE*)(dataRefNum));
+int ReadFromFileAt( AGDataRef dataRefNum, int64_t posn, int64_t *count, void *dataToRead )
+{
+	AGFile *file = ( AGFile * )dataRefNum;
+	int64_t goal = *count;
+	
+	if ( file->stream != NULL )
+	{
+		int result = SetFilePosition( dataRefNum, posn );
+		if ( result )
+		{
+			*count = 0;
+			return result;
+		}
+		return ReadFromFile( dataRefNum, count, dataToRead );
+	}
+	if ( IsPositionedFile( file ) )
+		return ReadPositioned( file, posn, count, dataToRead );
+	
+	const void *mapped;
+	MapFromFileAt( dataRefNum, posn, count, &mapped );
+	if ( *count > 0 )
+		memcpy( dataToRead, mapped, (size_t)*count );
 	return *count != goal;
 }
 
+
+// Wrap the contents of a whole file, allocated with malloc, in a file that
+// reads from them like a mapping; the contents are freed on failure
+static AGDataRef NewMemoryFileRef( unsigned char *contents, int64_t size )
+{
+	AGFile *file = ( AGFile * )malloc( sizeof( AGFile ) );
+	if ( file == NULL )
+	{
+		free( contents );
+		return NULL;
+	}
+	
+	file->stream = NULL;
+	file->map = contents;
+	file->mapSize = size;
+	file->inMemory = true;
+	file->posn = 0;
+	ClearPositionedFile( file );
+	return file;
+}
+
+// Read one file whole, with positioned reads, if it is no larger than maxBytes
+static AGDataRef ReadWholeFile( const char *fileName, int64_t maxBytes )
+{
+	AGDataRef refNum = OpenPositionedFile( fileName );
+	if ( refNum == NULL )
+		return NULL;
+	AGFile *file = ( AGFile * )refNum;
+	
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	bool ok = GetFileSizeEx( file->handle, &fileSize ) != 0;
+	int64_t size = fileSize.QuadPart;
+#else
+	struct stat info;
+	bool ok = fstat( file->fd, &info ) == 0;
+	int64_t size = info.st_size;
+#endif
+	ok = ok && size <= maxBytes && ( uint64_t )size <= ( size_t )-1;
+	
+	unsigned char *contents = NULL;
+	if ( ok && size > 0 )
+	{
+		contents = ( unsigned char * )malloc( ( size_t )size );
+		int64_t count = size;
+		ok = contents != NULL && ReadPositioned( file, 0, &count, contents ) == 0;
+	}
+	CloseFile( refNum );
+	
+	if ( !ok )
+	{
+		free( contents );
+		return NULL;
+	}
+	return NewMemoryFileRef( contents, size );
+}
+
+
+#ifdef AG_HAVE_IO_URING
+
+// Files whose opens, sizes, reads and closes are submitted together
+static const int32_t kRingBatch = 64;
+
+// The parts of an io_uring instance shared with the kernel
+struct AGRing {
+	int fd;
+	unsigned *sqHead;
+	unsigned *sqTail;
+	unsigned *sqMask;
+	unsigned *sqArray;
+	unsigned *cqHead;
+	unsigned *cqTail;
+	unsigned *cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqRing;
+	size_t sqRingBytes;
+	void *cqRing;					// the same as sqRing if the kernel maps them together
+	size_t cqRingBytes;
+	size_t sqesBytes;
+	unsigned queued;				// entries added since the last submission
+};
+
+static void CloseRing( AGRing *ring )
+{
+	if ( ring->sqes != NULL )
+		munmap( ring->sqes, ring->sqesBytes );
+	if ( ring->cqRing != NULL && ring->cqRing != ring->sqRing )
+		munmap( ring->cqRing, ring->cqRingBytes );
+	if ( ring->sqRing != NULL )
+		munmap( ring->sqRing, ring->sqRingBytes );
+	close( ring->fd );
+}
+
+// Set up a ring with room for entries submissions; returns false if the
+// kernel does not support io_uring ( or it is disabled )
+static bool OpenRing( AGRing *ring, unsigned entries )
+{
+	memset( ring, 0, sizeof( AGRing ) );
+	struct io_uring_params params;
+	memset( &params, 0, sizeof( params ) );
+	ring->fd = ( int )syscall( __NR_io_uring_setup, entries, &params );
+	if ( ring->fd < 0 )
+		return false;
+	
+	ring->sqRingBytes = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+	ring->cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	bool single = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+	if ( single && ring->cqRingBytes > ring->sqRingBytes )
+		ring->sqRingBytes = ring->cqRingBytes;
+	
+	void *mapping = mmap( NULL, ring->sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+						  ring->fd, IORING_OFF_SQ_RING );
+	ring->sqRing = mapping != MAP_FAILED ? mapping : NULL;
+	if ( single )
+		ring->cqRing = ring->sqRing;
+	else if ( ring->sqRing != NULL )
+	{
+		mapping = mmap( NULL, ring->cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+						ring->fd, IORING_OFF_CQ_RING );
+		ring->cqRing = mapping != MAP_FAILED ? mapping : NULL;
+	}
+	if ( ring->cqRing != NULL )
+	{
+		ring->sqesBytes = params.sq_entries * sizeof( struct io_uring_sqe );
+		mapping = mmap( NULL, ring->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+						ring->fd, IORING_OFF_SQES );
+		ring->sqes = mapping != MAP_FAILED ? ( struct io_uring_sqe * )mapping : NULL;
+	}
+	if ( ring->sqes == NULL )
+	{
+		CloseRing( ring );
+		return false;
+	}
+	
+	unsigned char *sq = ( unsigned char * )ring->sqRing;
+	unsigned char *cq = ( unsigned char * )ring->cqRing;
+	ring->sqHead = ( unsigned * )( sq + params.sq_off.head );
+	ring->sqTail = ( unsigned * )( sq + params.sq_off.tail );
+	ring->sqMask = ( unsigned * )( sq + params.sq_off.ring_mask );
+	ring->sqArray = ( unsigned * )( sq + params.sq_off.array );
+	ring->cqHead = ( unsigned * )( cq + params.cq_off.head );
+	ring->cqTail = ( unsigned * )( cq + params.cq_off.tail );
+	ring->cqMask = ( unsigned * )( cq + params.cq_off.ring_mask );
+	ring->cqes = ( struct io_uring_cqe * )( cq + params.cq_off.cqes );
+	return true;
+}
+
+// Add a cleared submission, tagged with userData, to be submitted by RunRing
+static struct io_uring_sqe *QueueOnRing( AGRing *ring, uint64_t userData )
+{
+	unsigned tail = *ring->sqTail + ring->queued++;
+	unsigned index = tail & *ring->sqMask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+	memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+	sqe->user_data = userData;
+	ring->sqArray[index] = index;
+	return sqe;
+}
+
+// The result of an entry that has not completed, which no entry returns
+static const int32_t kRingPending = INT32_MIN;
+
+// Submit the queued entries in one system call and wait for all of them to
+// complete, storing each result in results[userData]; returns false if the
+// ring itself fails, leaving kRingPending as the result of unfinished entries,
+// which may still be running in the kernel
+static bool RunRing( AGRing *ring, int32_t *results )
+{
+	unsigned queued = ring->queued;
+	__atomic_store_n( ring->sqTail, *ring->sqTail + queued, __ATOMIC_RELEASE );
+	ring->queued = 0;
+	
+	unsigned toSubmit = queued;
+	unsigned completed = 0;
+	while ( completed < queued )
+	{
+		int entered = ( int )syscall( __NR_io_uring_enter, ring->fd, toSubmit, queued - completed, 
+									  IORING_ENTER_GETEVENTS, NULL, 0 );
+		if ( entered < 0 && errno != EINTR )
+			return false;
+		if ( entered > 0 )
+			toSubmit -= ( unsigned )entered;
+		
+		unsigned head = *ring->cqHead;
+		unsigned tail = __atomic_load_n( ring->cqTail, __ATOMIC_ACQUIRE );
+		for ( ; head != tail; head++, completed++ )
+		{
+			const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+			results[cqe->user_data] = cqe->res;
+		}
+		__atomic_store_n( ring->cqHead, head, __ATOMIC_RELEASE );
+	}
+	return true;
+}
+
+// Read up to kRingBatch files through the ring, in two rounds: each file is
+// opened and its size found, then read and closed. Files that fail in any way
+// are retried with ReadWholeFile, which finds them missing again if they are.
+// Returns false if the ring itself failed, and must not be used again. Any
+// buffer an unfinished entry may still write to is then left allocated, and
+// any file it may still close left open, since the kernel finishes ( or
+// cancels ) those entries in its own time, even once the ring is closed.
+static bool ReadBatchOnRing( AGRing *ring, const char * const *fileNames, int32_t numberOfFiles, 
+							 int64_t maxBytes, AGDataRef *wholeFiles )
+{
+	int32_t results[4 * kRingBatch];
+	unsigned char *contents[kRingBatch];
+	
+	// The kernel writes the sizes, so they are allocated too
+	struct statx *sizes = ( struct statx * )malloc( numberOfFiles * sizeof( struct statx ) );
+	if ( sizes == NULL )
+	{
+		for ( int32_t i=0; i<numberOfFiles; i++ )
+			wholeFiles[i] = ReadWholeFile( fileNames[i], maxBytes );
+		return true;
+	}
+	
+	// Results are stored at 4 * file plus 0 for the open, 1 for the size,
+	// 2 for the read and 3 for the close
+	for ( int32_t i=0; i<4 * numberOfFiles; i++ )
+		results[i] = kRingPending;
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+	{
+		contents[i] = NULL;
+		struct io_uring_sqe *sqe = QueueOnRing( ring, 4 * i );
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = ( uint64_t )( uintptr_t )fileNames[i];
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		
+		sqe = QueueOnRing( ring, 4 * i + 1 );
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = ( uint64_t )( uintptr_t )fileNames[i];
+		sqe->len = STATX_SIZE;
+		sqe->off = ( uint64_t )( uintptr_t )&sizes[i];
+	}
+	bool opened = RunRing( ring, results );
+	
+	// Read each opened file that is small enough, closing it once it is read
+	for ( int32_t i=0; i<numberOfFiles && opened; i++ )
+	{
+		int fd = results[4 * i];
+		if ( fd < 0 )
+			continue;
+		
+		int64_t size = ( int64_t )sizes[i].stx_size;
+		if ( results[4 * i + 1] == 0 && size <= maxBytes && size <= 0x7FFFF000 )
+		{
+			contents[i] = ( unsigned char * )malloc( size > 0 ? ( size_t )size : 1 );
+			if ( contents[i] != NULL )
+			{
+				struct io_uring_sqe *sqe = QueueOnRing( ring, 4 * i + 2 );
+				sqe->opcode = IORING_OP_READ;
+				sqe->fd = fd;
+				sqe->addr = ( uint64_t )( uintptr_t )contents[i];
+				sqe->len = ( uint32_t )size;
+				sqe->off = 0;
+				sqe->flags = IOSQE_IO_LINK;
+			}
+		}
+		struct io_uring_sqe *sqe = QueueOnRing( ring, 4 * i + 3 );
+		sqe->opcode = IORING_OP_CLOSE;
+		sqe->fd = fd;
+	}
+	bool read = opened && RunRing( ring, results );
+	
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+	{
+		// A close that did not run ( after a short read ) is done here, unless
+		// it was queued and may still be running
+		int fd = results[4 * i];
+		bool closing = opened && results[4 * i + 3] == kRingPending;
+		if ( fd >= 0 && !closing && results[4 * i + 3] != 0 )
+			close( fd );
+		
+		int64_t size = opened ? ( int64_t )sizes[i].stx_size : 0;
+		if ( read && contents[i] != NULL && results[4 * i + 2] == size )
+			wholeFiles[i] = NewMemoryFileRef( contents[i], size );
+		else
+		{
+			if ( results[4 * i + 2] != kRingPending )
+				free( contents[i] );
+			bool tooLarge = opened && results[4 * i + 1] == 0 && size > maxBytes;
+			wholeFiles[i] = tooLarge ? NULL : ReadWholeFile( fileNames[i], maxBytes );
+		}
+	}
+	
+	if ( opened )
+		free( sizes );
+	return read;
+}
+
+#endif
+
+
+void ReadWholeFiles( const char * const *fileNames, int32_t numberOfFiles, int64_t maxBytes, bool useRing,
+					 AGDataRef *wholeFiles )
+{
+#ifdef AG_HAVE_IO_URING
+	AGRing ring;
+	if ( useRing && numberOfFiles > 0 && OpenRing( &ring, 2 * kRingBatch ) )
+	{
+		int32_t i = 0;
+		while ( i < numberOfFiles )
+		{
+			int32_t count = numberOfFiles - i < kRingBatch ? numberOfFiles - i : kRingBatch;
+			bool ringWorks = ReadBatchOnRing( &ring, fileNames + i, count, maxBytes, wholeFiles + i );
+			i += count;
+			if ( !ringWorks )
+				break;
+		}
+		CloseRing( &ring );
+		
+		// If the ring failed, the rest are read with pread
+		for ( ; i<numberOfFiles; i++ )
+			wholeFiles[i] = ReadWholeFile( fileNames[i], maxBytes );
+		return;
+	}
+#else
+	( void )useRing;
+#endif
+	
+	for ( int32_t i=0; i<numberOfFiles; i++ )
+		wholeFiles[i] = ReadWholeFile( fileNames[i], maxBytes );
+}
+
 #endif
@@ -2,6 +2,8 @@
 #ifndef FILEUTILS_H
 #define FILEUTILS_H
 
+#include "config.h"
+
 #define kAG_Creator  'AxG2'
 #define kAG_DocType  'AxGr'
 
@@ -15,7 +17,8 @@
 #if defined(__APPLE__) && !defined(NO_CARBON)
 typedef int AGDataRef;
 #else
-// on other systems, we'll use the FILE* defined in the C standard library
+// on other systems, we'll use a small handle wrapping either the FILE* defined
+// in the C standard library or a read-only memory mapping of the file
 // (we cast it to a void* here to avoid loading stdlib)
 typedef void* AGDataRef;
 #endif
@@ -24,8 +27,50 @@ AGDataRef OpenFile( const char *fileName );
 void CloseFile( AGDataRef dataRefNum );
 AGDataRef NewFile( const char *fileName );
 
-int SetFilePosition( AGDataRef dataRefNum, int posn );
-int ReadFromFile( AGDataRef dataRefNum, long *count, void *dataToRead );
-int WriteToFile( AGDataRef dataRefNum, long *count, void *dataToWrite );
+// File positions and byte counts are 64 bits wide on every platform, so
+// files ( and single columns ) larger than 2 GB can be read and written.
+int SetFilePosition( AGDataRef dataRefNum, int64_t posn );
+int GetFilePosition( AGDataRef dataRefNum, int64_t *posn );
+int GetFileLength( AGDataRef dataRefNum, int64_t *length );	// leaves the position unchanged
+int ReadFromFile( AGDataRef dataRefNum, int64_t *count, void *dataToRead );
+int WriteToFile( AGDataRef dataRefNum, int64_t *count, void *dataToWrite );
+
+// Hand anything written so far to the operating system, so that it survives
+// the writing process crashing.
+int FlushFile( AGDataRef dataRefNum );
+
+// Rename the closed file fromName to toName, replacing any file already there.
+int RenameFile( const char *fromName, const char *toName );
+
+// Memory-mapped files are opened read-only and support SetFilePosition and
+// ReadFromFile like any other file.  In addition, MapFromFile returns a pointer
+// to the next *count bytes of the mapping (instead of copying them) and advances
+// the position past them.  The pointer stays valid until CloseFile is called.
+// MapFromFile returns nonzero if the file is not mapped or is too short.
+AGDataRef OpenMappedFile( const char *fileName );
+int MapFromFile( AGDataRef dataRefNum, int64_t *count, const void **dataPointer );
+
+// ReadFromFileAt reads *count bytes starting at posn, and MapFromFileAt maps
+// them like MapFromFile.  For files opened with OpenPositionedFile ( read-only,
+// using pread rather than stdio ) or OpenMappedFile, these neither use nor move
+// the file position, so any number of threads may read from one such file at
+// once.  Files opened with OpenFile seek to posn first, so reads from them must
+// still be serialized.  Positioned files also support SetFilePosition and
+// ReadFromFile, through a position of their own.
+AGDataRef OpenPositionedFile( const char *fileName );
+int ReadFromFileAt( AGDataRef dataRefNum, int64_t posn, int64_t *count, void *dataToRead );
+int MapFromFileAt( AGDataRef dataRefNum, int64_t posn, int64_t *count, const void **dataPointer );
+
+// Read many small files whole, at once.  Each file no larger than maxBytes is
+// opened, read into memory and closed, and wholeFiles[i] is set to a read-only
+// file holding its contents, which supports everything a file opened with
+// OpenMappedFile does and is released with CloseFile.  Files that are larger,
+// or cannot be read, are left as 0, to be opened the usual way.  On Linux the
+// opens, reads and closes of a batch of files are submitted to the kernel
+// together through io_uring, when useRing is true and the kernel supports it,
+// so that they complete in a few system calls; otherwise each file is read
+// with pread.
+void ReadWholeFiles( const char * const *fileNames, int32_t numberOfFiles, int64_t maxBytes, bool useRing,
+					 AGDataRef *wholeFiles );
 
 #endif
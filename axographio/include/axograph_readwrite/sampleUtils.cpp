@@ -0,0 +1,386 @@
+
+#include <math.h>
+#include <limits>
+
+#include "byteswap.h"
+#include "sampleUtils.h"
+
+// The extremes are found by loops written with conditional expressions and
+// no early exits, so that the compiler can vectorize them.
+
+// Integers keep single running extremes, which the compiler reduces across
+// vector lanes itself. Mapping value to value - 1, and to ~value, as unsigned
+// numbers puts the positive, and the negative, values first, so the nearest
+// to zero on each side is an unsigned minimum.
+template <typename T, typename U>
+static void FindIntegerExtremes( const T *samples, const int64_t count, SampleExtremes<T> *extremes )
+{
+	T low = std::numeric_limits<T>::max();
+	T high = std::numeric_limits<T>::lowest();
+	U aboveZero = ( U )-1;
+	U belowZero = ( U )-1;
+	for ( int64_t i=0; i<count; i++ )
+	{
+		T value = samples[i];
+		U above = ( U )( ( U )value - 1 );
+		U below = ( U )~( U )value;
+		low = value < low ? value : low;
+		high = value > high ? value : high;
+		aboveZero = above < aboveZero ? above : aboveZero;
+		belowZero = below < belowZero ? below : belowZero;
+	}
+	extremes->low = low;
+	extremes->high = high;
+	extremes->lowestAboveZero = ( T )( aboveZero + 1 );
+	extremes->highestBelowZero = ( T )~belowZero;
+}
+
+// The compiler may not reorder a running floating point minimum, so each of
+// kRangeLanes interleaved lanes keeps its own, which it can hold in vector
+// registers, and the lanes are combined at the end.
+enum { kRangeLanes = 16 };
+
+template <typename T>
+static void FindFloatExtremes( const T *samples, const int64_t count, SampleExtremes<T> *extremes )
+{
+	const T largest = std::numeric_limits<T>::max();
+	const T lowest = std::numeric_limits<T>::lowest();
+	T lows[kRangeLanes];
+	T highs[kRangeLanes];
+	T aboveZero[kRangeLanes];
+	T belowZero[kRangeLanes];
+	for ( int j=0; j<kRangeLanes; j++ )
+	{
+		lows[j] = largest;
+		highs[j] = lowest;
+		aboveZero[j] = largest;
+		belowZero[j] = lowest;
+	}
+	
+	int64_t i = 0;
+	for ( ; i+kRangeLanes<=count; i+=kRangeLanes )
+	{
+		for ( int j=0; j<kRangeLanes; j++ )
+		{
+			T value = samples[i+j];
+			T above = value > 0 ? value : largest;
+			T below = value < 0 ? value : lowest;
+			lows[j] = value < lows[j] ? value : lows[j];
+			highs[j] = value > highs[j] ? value : highs[j];
+			aboveZero[j] = above < aboveZero[j] ? above : aboveZero[j];
+			belowZero[j] = below > belowZero[j] ? below : belowZero[j];
+		}
+	}
+	for ( ; i<count; i++ )
+	{
+		T value = samples[i];
+		lows[0] = value < lows[0] ? value : lows[0];
+		highs[0] = value > highs[0] ? value : highs[0];
+		aboveZero[0] = ( value > 0 && value < aboveZero[0] ) ? value : aboveZero[0];
+		belowZero[0] = ( value < 0 && value > belowZero[0] ) ? value : belowZero[0];
+	}
+	
+	for ( int j=1; j<kRangeLanes; j++ )
+	{
+		lows[0] = lows[j] < lows[0] ? lows[j] : lows[0];
+		highs[0] = highs[j] > highs[0] ? highs[j] : highs[0];
+		aboveZero[0] = aboveZero[j] < aboveZero[0] ? aboveZero[j] : aboveZero[0];
+		belowZero[0] = belowZero[j] > belowZero[0] ? belowZero[j] : belowZero[0];
+	}
+	extremes->low = lows[0];
+	extremes->high = highs[0];
+	extremes->lowestAboveZero = aboveZero[0];
+	extremes->highestBelowZero = belowZero[0];
+}
+
+void FindSampleExtremes( const int16_t *samples, int64_t count, SampleExtremes<int16_t> *extremes )
+{
+	FindIntegerExtremes<int16_t, uint16_t>( samples, count, extremes );
+}
+
+void FindSampleExtremes( const int32_t *samples, int64_t count, SampleExtremes<int32_t> *extremes )
+{
+	FindIntegerExtremes<int32_t, uint32_t>( samples, count, extremes );
+}
+
+void FindSampleExtremes( const float *samples, int64_t count, SampleExtremes<float> *extremes )
+{
+	FindFloatExtremes( samples, count, extremes );
+}
+
+void FindSampleExtremes( const double *samples, int64_t count, SampleExtremes<double> *extremes )
+{
+	FindFloatExtremes( samples, count, extremes );
+}
+
+
+// Without SSE2, each sample is quantized in turn, rounding in the current
+// rounding mode ( to nearest, ties to even, unless changed ) as the SSE2
+// conversion does. Returns the larger of the largest error and error.
+template <typename T>
+static double QuantizeScalar( const T *samples, const int64_t count, const double scale, const double offset, 
+							  int16_t *quantized, double error )
+{
+	for ( int64_t i=0; i<count; i++ )
+	{
+		double level = ( samples[i] - offset ) / scale;
+		if ( level != level )
+			level = 0;
+		else if ( level > 32767.0 )
+			level = 32767.0;
+		else if ( level < -32768.0 )
+			level = -32768.0;
+		long rounded = lrint( level );
+		quantized[i] = ( int16_t )rounded;
+		
+		double difference = fabs( rounded * scale + offset - samples[i] );
+		if ( difference > error )
+			error = difference;
+	}
+	return error;
+}
+
+// SSE2 is part of every x86-64 processor, so it needs no run time check
+#if defined(__SSE2__) || defined(_M_X64)
+#define SAMPLEUTILS_SSE2_KERNELS
+#include <emmintrin.h>
+
+static inline void LoadFour( const double *samples, __m128d *low, __m128d *high )
+{
+	*low = _mm_loadu_pd( samples );
+	*high = _mm_loadu_pd( samples + 2 );
+}
+
+static inline void LoadFour( const float *samples, __m128d *low, __m128d *high )
+{
+	__m128 floats = _mm_loadu_ps( samples );
+	*low = _mm_cvtps_pd( floats );
+	*high = _mm_cvtps_pd( _mm_movehl_ps( floats, floats ) );
+}
+
+// Four samples per pass: NaN levels are masked to zero and the rest clamped
+// before conversion, and the saturating pack narrows them to int16_t. MAXPD
+// returns its second operand when the first is NaN, so NaN errors are skipped.
+template <typename T>
+static double QuantizeSSE2( const T *samples, const int64_t count, const double scale, const double offset, 
+							int16_t *quantized )
+{
+	const __m128d scales = _mm_set1_pd( scale );
+	const __m128d offsets = _mm_set1_pd( offset );
+	const __m128d top = _mm_set1_pd( 32767.0 );
+	const __m128d bottom = _mm_set1_pd( -32768.0 );
+	const __m128d magnitude = _mm_castsi128_pd( _mm_set1_epi64x( 0x7FFFFFFFFFFFFFFFLL ) );
+	__m128d errors = _mm_setzero_pd();
+	
+	int64_t i = 0;
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		__m128d low, high;
+		LoadFour( samples + i, &low, &high );
+		__m128d lowLevel = _mm_div_pd( _mm_sub_pd( low, offsets ), scales );
+		__m128d highLevel = _mm_div_pd( _mm_sub_pd( high, offsets ), scales );
+		lowLevel = _mm_and_pd( lowLevel, _mm_cmpord_pd( lowLevel, lowLevel ) );
+		highLevel = _mm_and_pd( highLevel, _mm_cmpord_pd( highLevel, highLevel ) );
+		lowLevel = _mm_max_pd( _mm_min_pd( lowLevel, top ), bottom );
+		highLevel = _mm_max_pd( _mm_min_pd( highLevel, top ), bottom );
+		
+		__m128i lowRounded = _mm_cvtpd_epi32( lowLevel );
+		__m128i highRounded = _mm_cvtpd_epi32( highLevel );
+		__m128i rounded = _mm_unpacklo_epi64( lowRounded, highRounded );
+		_mm_storel_epi64( ( __m128i * )( quantized + i ), _mm_packs_epi32( rounded, rounded ) );
+		
+		__m128d lowError = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( lowRounded ), scales ), offsets ), low );
+		__m128d highError = _mm_sub_pd( _mm_add_pd( _mm_mul_pd( _mm_cvtepi32_pd( highRounded ), scales ), offsets ), high );
+		errors = _mm_max_pd( _mm_and_pd( lowError, magnitude ), errors );
+		errors = _mm_max_pd( _mm_and_pd( highError, magnitude ), errors );
+	}
+	
+	double lanes[2];
+	_mm_storeu_pd( lanes, errors );
+	double error = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+	return QuantizeScalar( samples + i, count - i, scale, offset, quantized + i, error );
+}
+
+#endif
+
+template <typename T>
+static void Quantize( const T *samples, const int64_t count, const double scale, const double offset, 
+					  int16_t *quantized, double *maximumError )
+{
+#ifdef SAMPLEUTILS_SSE2_KERNELS
+	*maximumError = QuantizeSSE2( samples, count, scale, offset, quantized );
+#else
+	*maximumError = QuantizeScalar( samples, count, scale, offset, quantized, 0 );
+#endif
+}
+
+void QuantizeFloatArray( const float *samples, int64_t count, double scale, double offset,
+						 int16_t *quantized, double *maximumError )
+{
+	Quantize( samples, count, scale, offset, quantized, maximumError );
+}
+
+void QuantizeDoubleArray( const double *samples, int64_t count, double scale, double offset,
+						  int16_t *quantized, double *maximumError )
+{
+	Quantize( samples, count, scale, offset, quantized, maximumError );
+}
+
+
+// The samples are checked a block at a time, stopping after the first block
+// holding a sample off the line. The position of each sample along the line
+// is counted as a double, which is exact for any possible number of samples.
+enum { kSequenceBlock = 4096 };
+
+static inline bool OffSequence( const double sample, const double expected, const double limit )
+{
+	return !( fabs( sample - expected ) <= limit );
+}
+
+#ifdef SAMPLEUTILS_SSE2_KERNELS
+
+static inline __m128d LoadTwo( const double *samples )
+{
+	return _mm_loadu_pd( samples );
+}
+
+static inline __m128d LoadTwo( const float *samples )
+{
+	return _mm_cvtps_pd( _mm_castsi128_ps( _mm_loadl_epi64( ( const __m128i * )samples ) ) );
+}
+
+// Two samples per pass; CMPLEPD is false for NaN, so NaN samples fail
+template <typename T>
+static bool CheckSequence( const T *samples, const int64_t count, const double first, const double step, 
+						   const double limit )
+{
+	const __m128d firsts = _mm_set1_pd( first );
+	const __m128d steps = _mm_set1_pd( step );
+	const __m128d limits = _mm_set1_pd( limit );
+	const __m128d twos = _mm_set1_pd( 2.0 );
+	const __m128d magnitude = _mm_castsi128_pd( _mm_set1_epi64x( 0x7FFFFFFFFFFFFFFFLL ) );
+	__m128d positions = _mm_set_pd( 1.0, 0.0 );
+	
+	int64_t i = 0;
+	while ( i + 2 <= count )
+	{
+		int64_t blockEnd = count - i < kSequenceBlock ? count : i + kSequenceBlock;
+		__m128d within = _mm_cmpeq_pd( firsts, firsts );
+		for ( ; i + 2 <= blockEnd; i += 2 )
+		{
+			__m128d expected = _mm_add_pd( _mm_mul_pd( positions, steps ), firsts );
+			__m128d difference = _mm_and_pd( _mm_sub_pd( LoadTwo( samples + i ), expected ), magnitude );
+			within = _mm_and_pd( within, _mm_cmple_pd( difference, limits ) );
+			positions = _mm_add_pd( positions, twos );
+		}
+		if ( _mm_movemask_pd( within ) != 3 )
+			return false;
+	}
+	return i == count || !OffSequence( samples[i], first + ( double )i * step, limit );
+}
+
+#else
+
+template <typename T>
+static bool CheckSequence( const T *samples, const int64_t count, const double first, const double step, 
+						   const double limit )
+{
+	for ( int64_t i=0; i<count; i++ )
+		if ( OffSequence( samples[i], first + ( double )i * step, limit ) )
+			return false;
+	return true;
+}
+
+#endif
+
+template <typename T>
+static bool FindSequence( const T *samples, const int64_t count, const double tolerance, 
+						  double *firstValue, double *increment )
+{
+	double first = count > 0 ? samples[0] : 0;
+	double step = count > 1 ? ( samples[count-1] - first ) / ( count - 1 ) : 0;
+	if ( !CheckSequence( samples, count, first, step, tolerance * fabs( step ) ) )
+		return false;
+	
+	*firstValue = first;
+	*increment = step;
+	return true;
+}
+
+bool FindFloatSequence( const float *samples, int64_t count, double tolerance, 
+						double *firstValue, double *increment )
+{
+	return FindSequence( samples, count, tolerance, firstValue, increment );
+}
+
+bool FindDoubleSequence( const double *samples, int64_t count, double tolerance, 
+						 double *firstValue, double *increment )
+{
+	return FindSequence( samples, count, tolerance, firstValue, increment );
+}
+
+
+// The sums of a block fit in 32 bits, and are added to the 64 bit totals 
+// once per block; only a block holding a new extreme is searched again for 
+// the index of its first occurrence.
+static const int32_t kStatisticsBlock = 4096;
+
+static void AccumulateShortBlock( const int16_t *block, const int32_t count, const int64_t firstIndex, 
+								  ShortStatistics *statistics )
+{
+	int32_t sum = 0;
+	int64_t sumOfSquares = 0;
+	int16_t low = block[0];
+	int16_t high = block[0];
+	for ( int32_t j=0; j<count; j++ )
+	{
+		int16_t value = block[j];
+		sum += value;
+		sumOfSquares += ( int32_t )value * value;
+		low = value < low ? value : low;
+		high = value > high ? value : high;
+	}
+	statistics->sum += sum;
+	statistics->sumOfSquares += sumOfSquares;
+	
+	if ( statistics->minimumIndex < 0 || low < statistics->minimum )
+	{
+		int32_t j = 0;
+		while ( block[j] != low )
+			j++;
+		statistics->minimum = low;
+		statistics->minimumIndex = firstIndex + j;
+	}
+	if ( statistics->maximumIndex < 0 || high > statistics->maximum )
+	{
+		int32_t j = 0;
+		while ( block[j] != high )
+			j++;
+		statistics->maximum = high;
+		statistics->maximumIndex = firstIndex + j;
+	}
+}
+
+void FindShortStatistics( const int16_t *samples, int64_t count, bool swapped, ShortStatistics *statistics )
+{
+	statistics->count = count;
+	statistics->sum = 0;
+	statistics->sumOfSquares = 0;
+	statistics->minimum = 0;
+	statistics->maximum = 0;
+	statistics->minimumIndex = -1;
+	statistics->maximumIndex = -1;
+	
+	int16_t buffer[kStatisticsBlock];
+	for ( int64_t start=0; start<count; start+=kStatisticsBlock )
+	{
+		int32_t blockCount = ( int32_t )( count - start < kStatisticsBlock ? count - start : kStatisticsBlock );
+		const int16_t *block = samples + start;
+		if ( swapped )
+		{
+			ByteSwapCopyArray( block, buffer, blockCount, sizeof( int16_t ) );
+			block = buffer;
+		}
+		AccumulateShortBlock( block, blockCount, start, statistics );
+	}
+}
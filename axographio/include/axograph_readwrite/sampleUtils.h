@@ -0,0 +1,74 @@
+#ifndef SAMPLEUTILS_H
+#define SAMPLEUTILS_H
+
+#include "config.h"
+
+//------------------------ Range Routines  -------------------------
+
+// The lowest and highest of an array of samples, and those nearest zero on
+// either side ( valid only if high > 0 and low < 0 respectively ). Unordered
+// ( NaN ) samples are skipped. With no samples, low is the largest value of
+// the type and high the lowest.
+template <typename T>
+struct SampleExtremes {
+	T low;
+	T high;
+	T lowestAboveZero;
+	T highestBelowZero;
+};
+
+// find the extremes of an array of count samples, in native byte order
+void FindSampleExtremes( const int16_t *samples, int64_t count, SampleExtremes<int16_t> *extremes );
+void FindSampleExtremes( const int32_t *samples, int64_t count, SampleExtremes<int32_t> *extremes );
+void FindSampleExtremes( const float *samples, int64_t count, SampleExtremes<float> *extremes );
+void FindSampleExtremes( const double *samples, int64_t count, SampleExtremes<double> *extremes );
+
+
+//------------------------ Quantize Routines  -------------------------
+
+// These store each sample as the 16 bit integer nearest ( samples[i] - offset ) / scale
+// ( ties to even ), saturated to the range of an int16_t, with NaN samples stored as 0,
+// and set maximumError to the largest difference between a sample and
+// quantized[i] * scale + offset, skipping NaN samples. scale must not be zero.
+
+void QuantizeFloatArray( const float *samples, int64_t count, double scale, double offset,
+						 int16_t *quantized, double *maximumError );
+void QuantizeDoubleArray( const double *samples, int64_t count, double scale, double offset,
+						  int16_t *quantized, double *maximumError );
+
+
+//------------------------ Linear Sequence Routines  -------------------------
+
+// These return true, with the first value and increment, if every sample lies
+// within tolerance * | increment | of firstValue + i * increment, where the line
+// runs from the first sample to the last, so the samples can be written as a
+// series column. They stop at the first block of samples that does not ( any
+// NaN sample fails ). Constant samples form a sequence with an increment of 0.
+
+bool FindFloatSequence( const float *samples, int64_t count, double tolerance, 
+						double *firstValue, double *increment );
+bool FindDoubleSequence( const double *samples, int64_t count, double tolerance, 
+						 double *firstValue, double *increment );
+
+
+//------------------------ Statistics Routines  -------------------------
+
+// Exact sums, and the first positions of the extremes, of an array of 16 bit
+// samples, from which those of samples[i] * scale + offset follow
+struct ShortStatistics {
+	int64_t count;
+	int64_t sum;
+	int64_t sumOfSquares;
+	int16_t minimum;
+	int16_t maximum;
+	int64_t minimumIndex;		// -1 if there are no samples
+	int64_t maximumIndex;
+};
+
+// find the statistics of count samples, which are byte swapped ( e.g., still in
+// file byte order ) if swapped is true; they are swapped a block at a time as
+// they are read, without modifying or copying the array
+void FindShortStatistics( const int16_t *samples, int64_t count, bool swapped, ShortStatistics *statistics );
+
+
+#endif
@@ -12,7 +12,9 @@ import os.path
 import pkg_resources
 import os
 import tempfile
+import shutil
 import copy
+import threading
 
 import axographio
 
@@ -85,6 +87,494 @@ class TestSampleFiles(unittest.TestCase):
         self.assertEqual(file.data[0][999], 0.05)
 
 
+    def test_mapped_files(self):
+        for filename in example_files.values():
+            file = axographio.read(filename)
+            mapped = axographio.read(filename, mmap=True)
+            self.assertEqual(mapped.fileformat, file.fileformat)
+            self.assertEqual(mapped.names, file.names)
+            self.assertEqual(len(mapped.data), len(file.data))
+            for a, b in zip(file.data, mapped.data):
+                self.assertEqual(type(a), type(b))
+                self.assertTrue(np.all(np.asarray(a) == np.asarray(b)))
+                if isinstance(b, np.ndarray):
+                    self.assertFalse(b.flags.writeable)
+                elif isinstance(b, axographio.scaledarray):
+                    self.assertFalse(b.data.flags.writeable)
+
+
+    def test_read_header(self):
+        for filename in example_files.values():
+            file = axographio.read(filename)
+            header = axographio.read_header(filename)
+            self.assertEqual(header.fileformat, file.fileformat)
+            self.assertEqual(header.names, file.names)
+            self.assertEqual([c.points for c in header.columns],
+                    [len(d) for d in file.data])
+            size = os.path.getsize(filename)
+            for c in header.columns:
+                self.assertTrue(c.offset + c.nbytes <= size)
+        header = axographio.read_header(example_files['axograph_x_format'])
+        self.assertEqual([c.type for c in header.columns], [9] + [10] * 6)
+        self.assertEqual(header.columns[1].offset, 106)
+        self.assertEqual(header.columns[1].nbytes, 2000)
+
+
+    def test_read_trailer(self):
+        trailer = axographio.read_trailer(
+                example_files['axograph_x_format'])
+        self.assertEqual(trailer.comment, '')
+        self.assertTrue(trailer.notes.startswith(
+            '--- Acquisition Settings ---'))
+        self.assertEqual([(t.x_column, t.y_column) for t in trailer.traces],
+                [(0, y) for y in range(1, 7)])
+
+        # the stored ranges match the data
+        contents = axographio.read(example_files['axograph_x_format'],
+                dtype=np.float64)
+        for trace in trailer.traces:
+            self.assertTrue(trace.x_regular and trace.x_monotonic)
+            self.assertAlmostEqual(trace.x_max,
+                    contents.data[trace.x_column].max())
+            self.assertAlmostEqual(trace.y_min / 1e-12,
+                    contents.data[trace.y_column].min() / 1e-12)
+
+        # the older formats have no trailer
+        trailer = axographio.read_trailer(
+                example_files['old_digitized_format'])
+        self.assertEqual((trailer.comment, trailer.notes, trailer.traces),
+                ('', '', []))
+
+        # a damaged comment length running past the end of the file is an
+        # error rather than a 2 GB allocation
+        header = axographio.read_header(example_files['axograph_x_format'])
+        trailerposition = header.columns[-1].offset + header.columns[-1].nbytes
+        with open(example_files['axograph_x_format'], 'rb') as f:
+            contents = bytearray(f.read())
+        contents[trailerposition:trailerposition + 4] = b'\x7f\xff\xff\xf0'
+        handle, tempfilename = tempfile.mkstemp()
+        try:
+            with os.fdopen(handle, 'wb') as f:
+                f.write(contents)
+            self.assertRaises(IOError, axographio.read_trailer, tempfilename)
+        finally:
+            os.remove(tempfilename)
+
+        # so are a point count running past the end of the file, a negative
+        # one, and a file cut short in its last column, however it is read
+        # (the last column's header starts where the samples before it end)
+        with open(example_files['axograph_x_format'], 'rb') as f:
+            original = f.read()
+        last = header.columns[-2].offset + header.columns[-2].nbytes
+        for contents in [
+                original[:last] + b'\x7f\xff\xff\xf0' + original[last + 4:],
+                original[:last] + b'\xff\xff\xff\xff' + original[last + 4:],
+                original[:header.columns[-1].offset + 100]]:
+            handle, tempfilename = tempfile.mkstemp()
+            try:
+                with os.fdopen(handle, 'wb') as f:
+                    f.write(contents)
+                for read in [axographio.read_header, axographio.read,
+                        lambda name: axographio.read(name, mmap=True),
+                        lambda name: axographio.read_many([name])]:
+                    self.assertRaises(IOError, read, tempfilename)
+            finally:
+                os.remove(tempfilename)
+
+
+    def test_select_columns(self):
+        filename = example_files['old_digitized_format']
+        file = axographio.read(filename)
+        for columns in [[0, 5, 28], ['Time (s)', 5, -1],
+                lambda c: c.name in ['Time (s)', 'Column6', 'Column29']]:
+            selected = axographio.read(filename, columns=columns)
+            self.assertEqual(selected.names,
+                    [file.names[0], file.names[5], file.names[28]])
+            for a, b in zip([file.data[0], file.data[5], file.data[28]],
+                    selected.data):
+                self.assertTrue(np.all(np.asarray(a) == np.asarray(b)))
+        selected = axographio.read(example_files['old_graph_format'],
+                columns='Current (A)')
+        self.assertEqual(len(selected.data), 2)
+        self.assertRaises(KeyError, axographio.read, filename,
+                columns='Time (ms)')
+
+
+    def test_read_ranges(self):
+        for filename in example_files.values():
+            file = axographio.read(filename)
+            for mmap in [False, True]:
+                part = axographio.read(filename, mmap=mmap, ranges=(10, 50))
+                for a, b in zip(file.data, part.data):
+                    self.assertEqual(type(a), type(b))
+                    self.assertEqual(len(b), 40)
+                    self.assertTrue(np.allclose(np.asarray(a)[10:50],
+                        np.asarray(b), rtol=1e-12, atol=0))
+                part = axographio.read(filename, mmap=mmap, columns=[0, 1],
+                        ranges=[None, slice(-5, None)])
+                self.assertEqual(len(part.data[0]), len(file.data[0]))
+                self.assertTrue(np.all(np.asarray(file.data[1])[-5:]
+                    == np.asarray(part.data[1])))
+
+
+    def test_read_dtype(self):
+        for filename in example_files.values():
+            file = axographio.read(filename)
+            for mmap in [False, True]:
+                for dtype in [np.float32, np.float64]:
+                    converted = axographio.read(filename, mmap=mmap,
+                            dtype=dtype)
+                    self.assertEqual(converted.names, file.names)
+                    for a, b in zip(file.data, converted.data):
+                        self.assertEqual(b.dtype, dtype)
+                        self.assertTrue(np.allclose(np.asarray(a, dtype),
+                            b, rtol=1e-6, atol=0))
+                part = axographio.read(filename, mmap=mmap, ranges=(10, 50),
+                        dtype=np.float64)
+                for a, b in zip(file.data, part.data):
+                    self.assertTrue(np.allclose(np.asarray(a)[10:50], b,
+                        rtol=1e-12, atol=0))
+        self.assertRaises(ValueError, axographio.read,
+                example_files['axograph_x_format'], dtype=np.int16)
+
+
+    def test_threaded_reads(self):
+        expected = dict((name, axographio.read(filename))
+                for name, filename in example_files.items())
+        results = []
+        def reader(name, filename):
+            for i in range(20):
+                results.append((name, axographio.read(filename)))
+        threads = [threading.Thread(target=reader, args=item)
+                for item in list(example_files.items()) * 2]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(len(results), 20 * len(threads))
+        for name, file in results:
+            self.assertEqual(file.names, expected[name].names)
+            for a, b in zip(expected[name].data, file.data):
+                self.assertTrue(np.all(np.asarray(a) == np.asarray(b)))
+
+
+    def test_parallel_read(self):
+        # reading on several threads gives the same columns as reading
+        # on one, in any combination with the other options
+        for filename in example_files.values():
+            for options in [{}, {'dtype': np.float32},
+                    {'dtype': np.float64, 'mmap': True},
+                    {'columns': [0, -1], 'ranges': (10, 150)}]:
+                serial = axographio.read(filename, **options)
+                for threads in [0, 1, 4]:
+                    parallel = axographio.read(filename, threads=threads,
+                            **options)
+                    self.assertEqual(parallel.names, serial.names)
+                    for a, b in zip(serial.data, parallel.data):
+                        self.assertEqual(type(a), type(b))
+                        self.assertTrue(np.all(np.asarray(a)
+                            == np.asarray(b)))
+        self.assertRaises(ValueError, axographio.read,
+                example_files['axograph_x_format'], lazy=True, threads=2)
+
+
+    def test_lazy_read(self):
+        # columns are read on first access and cached, within the budget
+        for filename in example_files.values():
+            eager = axographio.read(filename)
+            with axographio.read(filename, lazy=True,
+                    cache_bytes=100) as lazy:
+                self.assertEqual(lazy.names, eager.names)
+                self.assertEqual(lazy.data.cached(), [])
+                for i in [1, -1, 1]:
+                    self.assertTrue(np.all(np.asarray(lazy.data[i])
+                        == np.asarray(eager.data[i])))
+                self.assertEqual(lazy.data.cached(), [1])
+                self.assertEqual(len(list(lazy.data)), len(eager.data))
+
+        with axographio.read(example_files['axograph_x_format'], lazy=True,
+                columns=[0, 2], dtype=np.float32) as lazy:
+            self.assertEqual(len(lazy.data), 2)
+            self.assertEqual(lazy.data[1].dtype, np.float32)
+            self.assertEqual(lazy.data.cached(), [1])
+
+
+    def test_concurrent_lazy_reads(self):
+        # columns of one open file decode correctly in parallel threads
+        filename = example_files['old_digitized_format']
+        eager = axographio.read(filename, dtype=np.float64)
+        failures = []
+        with axographio.read(filename, lazy=True, dtype=np.float64,
+                cache_bytes=0) as lazy:
+            def read_columns(offset):
+                for i in range(50):
+                    c = (offset + i) % len(eager.data)
+                    if not np.all(lazy.data[c] == eager.data[c]):
+                        failures.append(c)
+            threads = [threading.Thread(target=read_columns, args=(t,))
+                    for t in range(8)]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+        self.assertEqual(failures, [])
+
+
+    def test_read_matrix(self):
+        # every sweep is read into its row, scaled as by read(dtype=...)
+        for filename in example_files.values():
+            columns = axographio.read(filename, dtype=np.float64)
+            for dtype in [np.float32, np.float64]:
+                sweeps = axographio.read_matrix(filename, dtype=dtype)
+                self.assertEqual(sweeps.names, columns.names)
+                self.assertTrue(np.all(np.asarray(sweeps.time)
+                    == columns.data[0]))
+                self.assertEqual(sweeps.data.dtype, dtype)
+                self.assertTrue(sweeps.data.flags.c_contiguous)
+                self.assertTrue(np.all(sweeps.data
+                    == np.vstack(columns.data[1:]).astype(dtype)))
+
+        sweeps = axographio.read_matrix(example_files['old_digitized_format'])
+        self.assertEqual(sweeps.data.shape, (28, 200))
+
+
+    def test_read_envelope(self):
+        # each bin's extremes match those of the values read in full
+        for filename in example_files.values():
+            columns = axographio.read(filename, dtype=np.float64)
+            for colnum in [0, 1, len(columns.names) - 1]:
+                values = columns.data[colnum]
+                for bins in [1, 7, 100, len(values) + 5]:
+                    envelope = axographio.read_envelope(filename, colnum,
+                            bins)
+                    nbins = min(bins, len(values))
+                    starts = np.arange(nbins) * len(values) // nbins
+                    self.assertEqual(envelope.name, columns.names[colnum])
+                    self.assertEqual(envelope.points, len(values))
+                    self.assertTrue(np.allclose(envelope.minima,
+                        np.minimum.reduceat(values, starts)))
+                    self.assertTrue(np.allclose(envelope.maxima,
+                        np.maximum.reduceat(values, starts)))
+                    self.assertTrue(np.allclose(envelope.time,
+                        columns.data[0][starts]))
+
+        envelope = axographio.read_envelope(
+                example_files['axograph_x_format'], 'Time (s)', 10)
+        self.assertEqual(len(envelope.minima), 10)
+        self.assertRaises(ValueError, axographio.read_envelope,
+                example_files['axograph_x_format'], 1, 0)
+
+        # bins that start past the end of a shorter time column, whether a
+        # linear sequence or an array, have no time
+        jittered = np.arange(100) * 0.01
+        jittered[50] += 1e-6
+        for time in [axographio.linearsequence(100, 0., 0.01), jittered]:
+            written = axographio.file_contents(['time', 'data'],
+                    [time, np.arange(1000, dtype=np.float64)])
+            handle, tempfilename = tempfile.mkstemp()
+            try:
+                written.write(tempfilename)
+                envelope = axographio.read_envelope(tempfilename, 1, 20)
+            finally:
+                os.close(handle)
+                os.remove(tempfilename)
+            self.assertTrue(np.allclose(envelope.time[:2],
+                np.asarray(time)[[0, 50]]))
+            self.assertTrue(np.all(np.isnan(envelope.time[2:])))
+            self.assertTrue(np.all(envelope.maxima == envelope.minima + 49))
+
+
+    def test_read_chunks(self):
+        # the chunks of each column add up to the whole column
+        for filename in example_files.values():
+            for dtype in [None, np.float32, np.float64]:
+                columns = axographio.read(filename, dtype=dtype)
+                for chunk_points in [1, 300, 5000]:
+                    chunks = list(axographio.read_chunks(filename,
+                        chunk_points=chunk_points, dtype=dtype))
+                    longest = max(len(d) for d in columns.data)
+                    self.assertEqual(len(chunks),
+                            -(-longest // chunk_points))
+                    for i, chunk in enumerate(chunks):
+                        self.assertEqual(chunk.start, i * chunk_points)
+                        self.assertEqual(chunk.names, columns.names)
+                        self.assertEqual(chunk.fileformat,
+                                columns.fileformat)
+                    for c, column in enumerate(columns.data):
+                        pieces = [np.asarray(chunk.data[c])
+                                for chunk in chunks]
+                        self.assertTrue(np.allclose(np.concatenate(pieces),
+                            np.asarray(column), rtol=1e-12, atol=1e-20))
+
+        chunks = axographio.read_chunks(example_files['axograph_x_format'],
+                columns=[0, 'Current (A)'], chunk_points=400)
+        with chunks:
+            chunk = next(chunks)
+            self.assertEqual(chunk.names, ['Time (s)', 'Current (A)'])
+            self.assertTrue(isinstance(chunk.data[0],
+                axographio.linearsequence))
+            self.assertTrue(isinstance(chunk.data[1],
+                axographio.scaledarray))
+        self.assertRaises(StopIteration, next, chunks)
+
+
+    def test_column_statistics(self):
+        # statistics computed from the stored samples, or in closed form,
+        # match those of the values, in either byte order
+        def close(a, b):
+            return np.isclose(a, b, rtol=1e-10, atol=1e-20)
+
+        filename = example_files['axograph_x_format']
+        for file in [axographio.read(filename),
+                axographio.read(filename, mmap=True)]:
+            for column in file.data:
+                values = np.asarray(column)
+                for start, stop in [(None, None), (100, 400), (-50, None)]:
+                    window = values[start:stop]
+                    first = slice(start, stop).indices(len(values))[0]
+                    self.assertTrue(close(column.sum(start, stop),
+                        window.sum()))
+                    self.assertTrue(close(column.mean(start, stop),
+                        window.mean()))
+                    self.assertTrue(close(column.std(1, start, stop),
+                        window.std(ddof=1)))
+                    self.assertTrue(close(column.min(start, stop),
+                        window.min()))
+                    self.assertTrue(close(column.max(start, stop),
+                        window.max()))
+                    self.assertEqual(column.argmin(start, stop),
+                            first + window.argmin())
+                    self.assertEqual(column.argmax(start, stop),
+                            first + window.argmax())
+                self.assertTrue(np.all(close(list(column), values)))
+
+
+    def test_read_many(self):
+        names = sorted(example_files)
+        paths = [example_files[name] for name in names] * 5
+        files = axographio.read_many(paths, workers=4)
+        self.assertEqual(len(files), len(paths))
+        for path, file in zip(paths, files):
+            expected = axographio.read(path)
+            self.assertEqual(file.fileformat, expected.fileformat)
+            self.assertEqual(file.names, expected.names)
+            for a, b in zip(expected.data, file.data):
+                self.assertEqual(type(a), type(b))
+                self.assertTrue(np.all(np.asarray(a) == np.asarray(b)))
+        files = axographio.read_many(paths, columns=[0, -1])
+        for file in files:
+            self.assertEqual(len(file.data), 2)
+        self.assertRaises(IOError, axographio.read_many,
+                paths + ['no such file'])
+        self.assertRaises(KeyError, axographio.read_many, paths,
+                columns='Time (s)')
+
+
+    def test_read_many_whole_files(self):
+        # small files are read whole, with pread or (where the kernel and
+        # build support it) through io_uring, and a file over 4 MB is opened
+        # as usual; all of them come back as read would return them
+        written = axographio.file_contents(['time', 'data'],
+                [axographio.linearsequence(600000, 0., 0.01),
+                np.arange(600000, dtype=np.float64)])
+        handle, largefilename = tempfile.mkstemp()
+        try:
+            written.write(largefilename)
+            paths = sorted(example_files.values()) * 30
+            paths.insert(40, largefilename)
+            expected = [axographio.read(path) for path in paths]
+            for use_ring in [False, True]:
+                files = axographio.read_many(paths, workers=2,
+                        use_ring=use_ring)
+                self.assertEqual(len(files), len(paths))
+                for a, b in zip(expected, files):
+                    self.assertEqual(a.names, b.names)
+                    for x, y in zip(a.data, b.data):
+                        self.assertTrue(np.all(np.asarray(x) == np.asarray(y)))
+
+                # a missing file in the middle of a batch is reported
+                missing = paths[:10] + ['no such file'] + paths[10:]
+                self.assertRaises(IOError, axographio.read_many, missing,
+                        use_ring=use_ring)
+        finally:
+            os.close(handle)
+            os.remove(largefilename)
+
+
+    def test_corpus_index(self):
+        directory = tempfile.mkdtemp()
+        try:
+            data = os.path.join(directory, 'data')
+            os.makedirs(os.path.join(data, 'sub'))
+            paths = {}
+            for name, filename in example_files.items():
+                paths[name] = os.path.join(data, 'sub', name)
+                shutil.copy(filename, paths[name])
+            with open(os.path.join(data, 'notes.txt'), 'w') as f:
+                f.write('not an axograph file')
+            indexname = os.path.join(directory, 'corpus.axgindex')
+
+            with axographio.corpus_index(indexname) as index:
+                self.assertEqual(index.update(data), (4, 0))
+                self.assertEqual(len(index), 3)
+                for name, path in paths.items():
+                    entry = index[path]
+                    header = axographio.read_header(path)
+                    trailer = axographio.read_trailer(path)
+                    self.assertEqual(entry.fileformat, header.fileformat)
+                    self.assertEqual(entry.names, header.names)
+                    self.assertEqual([repr(c) for c in entry.columns],
+                            [repr(c) for c in header.columns])
+                    self.assertEqual(entry.trailer.notes, trailer.notes)
+                    self.assertEqual(
+                            [(t.y_min, t.y_max) for t in entry.trailer.traces],
+                            [(t.y_min, t.y_max) for t in trailer.traces])
+
+            # queries need only the index, and crawls only changed files
+            with axographio.corpus_index(indexname) as index:
+                found = index.find(column='Current (A)', min_points=1000)
+                self.assertEqual([entry.path for entry in found],
+                        [paths['axograph_x_format'],
+                        paths['old_graph_format']])
+                found = index.find(column='Current (A)', min_points=1000,
+                        type=10)
+                self.assertEqual([entry.path for entry in found],
+                        [paths['axograph_x_format']])
+                self.assertEqual(index.find(column='Current (A)',
+                        min_points=2049), [])
+                self.assertEqual(len(index.find(
+                        fileformat=axographio.axograph_x_format)), 1)
+                self.assertEqual(index.update(data), (0, 0))
+
+                os.remove(paths['old_graph_format'])
+                shutil.copy(example_files['axograph_x_format'],
+                        paths['old_digitized_format'])
+                self.assertEqual(index.update(data), (1, 1))
+                self.assertEqual(len(index), 2)
+                self.assertFalse(paths['old_graph_format'] in index)
+                self.assertEqual(index[paths['old_digitized_format']].names,
+                        index[paths['axograph_x_format']].names)
+
+                # files left out by extension are dropped from the index
+                self.assertEqual(index.update(data, extensions=['.TXT']),
+                        (0, 2))
+                self.assertEqual(len(index), 0)
+
+                # damaged Axograph files are left out, to be scanned again
+                damaged = os.path.join(data, 'damaged.axgx')
+                with open(example_files['axograph_x_format'], 'rb') as f:
+                    contents = f.read()
+                with open(damaged, 'wb') as f:
+                    f.write(contents[:3000])
+                self.assertEqual(index.update(data, extensions=['.axgx']),
+                        (1, 1))
+                self.assertFalse(damaged in index)
+                self.assertEqual(index.update(data, extensions=['.axgx']),
+                        (1, 0))
+        finally:
+            shutil.rmtree(directory)
+
+
 
 class TestReadWrite(unittest.TestCase):
     """Test reading and writing of different data types"""
@@ -133,7 +623,8 @@ class TestReadWrite(unittest.TestCase):
             for pass_number in range(2):
                 handle, tempfilename = tempfile.mkstemp()
                 try:
-                    currentfile.write(tempfilename)
+                    # keep the time column as given, rather than as a series
+                    currentfile.write(tempfilename, series_tolerance=None)
                     currentfile = axographio.read(tempfilename)
                 finally:
                     os.close(handle)
@@ -152,6 +643,136 @@ class TestReadWrite(unittest.TestCase):
                         self.roughly(a, accuracy) == self.roughly(b, accuracy)))
 
 
+    def test_write_readonly(self):
+        # writing must neither modify nor copy-on-write the column data
+        doublecol = np.linspace(-1., 1., 50000)
+        shortcol = np.arange(50000, dtype='>i2')
+        expected = [doublecol.copy(), shortcol.copy()]
+        doublecol.flags.writeable = False
+        shortcol.flags.writeable = False
+        written = axographio.file_contents(['double', 'short'],
+                [doublecol, shortcol])
+
+        handle, tempfilename = tempfile.mkstemp()
+        try:
+            written.write(tempfilename)
+            reread = axographio.read(tempfilename)
+        finally:
+            os.close(handle)
+            os.remove(tempfilename)
+
+        for original, a, b in zip(expected, written.data, reread.data):
+            self.assertTrue(np.all(original == a))
+            self.assertTrue(np.all(original == b))
+
+
+    def test_asscaledarray(self):
+        # samples are rounded to the nearest level, not truncated
+        for dtype in [np.float32, np.float64]:
+            x = np.sin(np.arange(10000) * 0.01).astype(dtype) * 3 + 0.5
+            scaled, error = axographio.asscaledarray(x, return_error=True)
+            difference = np.abs(np.asarray(scaled) - x)
+            self.assertEqual(scaled.data.dtype, np.int16)
+            self.assertAlmostEqual(error, difference.max())
+            self.assertTrue(error <= scaled.scale * 0.5001)
+            self.assertEqual((scaled.data.min(), scaled.data.max()),
+                    (-32767, 32767))
+
+        # NaN samples are stored as the offset
+        scaled = axographio.asscaledarray([0.25, np.nan, -1.], forceoffset=0.)
+        self.assertEqual(list(scaled.data), [8192, 0, -32767])
+
+
+    def test_write_series(self):
+        # a regularly spaced time column is stored as a series
+        time = np.arange(100000) * 2e-5 + 0.5
+        jittered = time.copy()
+        jittered[5000] += 1e-6
+
+        for column, expected_type in [(time, 9), (time.astype(np.float32), 6),
+                (jittered, 7)]:
+            written = axographio.file_contents(['time', 'data'],
+                    [column, np.zeros(len(column), dtype=np.int16)])
+            handle, tempfilename = tempfile.mkstemp()
+            try:
+                written.write(tempfilename)
+                header = axographio.read_header(tempfilename)
+                reread = axographio.read(tempfilename)
+            finally:
+                os.close(handle)
+                os.remove(tempfilename)
+
+            self.assertEqual(header.columns[0].type, expected_type)
+            self.assertTrue(np.allclose(np.asarray(reread.data[0]), column,
+                rtol=0, atol=2e-11))
+
+
+    def test_write_trailer(self):
+        # the ranges found while writing are stored in the trace headers
+        time = axographio.linearsequence(1000, 0., 0.01)
+        sine = np.sin(np.arange(1000) * 0.05)
+        counts = np.arange(-500, 500, dtype=np.int32)
+        written = axographio.file_contents(['time', 'sine', 'counts'],
+                [time, sine, counts])
+
+        handle, tempfilename = tempfile.mkstemp()
+        try:
+            written.write(tempfilename, trailer=True, notes='gain 10')
+            trailer = axographio.read_trailer(tempfilename)
+            reread = axographio.read(tempfilename)
+        finally:
+            os.close(handle)
+            os.remove(tempfilename)
+
+        self.assertEqual((trailer.comment, trailer.notes), ('', 'gain 10'))
+        self.assertEqual([(t.x_column, t.y_column) for t in trailer.traces],
+                [(0, 1), (0, 2)])
+        for trace, column in zip(trailer.traces, [sine, counts]):
+            self.assertTrue(trace.x_regular and trace.x_monotonic)
+            self.assertAlmostEqual(trace.x_interval, 0.01)
+            self.assertAlmostEqual(trace.x_max, 9.99)
+            self.assertEqual((trace.y_min, trace.y_max),
+                    (column.min(), column.max()))
+            self.assertEqual(trace.y_min_positive, column[column > 0].min())
+        self.assertTrue(np.all(reread.data[1] == sine))
+
+        # only Axograph X files have a trailer
+        written.fileformat = axographio.old_digitized_format
+        self.assertRaises(ValueError, written.write, tempfilename,
+                trailer=True)
+
+
+    def test_stream_writer(self):
+        # samples appended in uneven chunks, at different rates, come back
+        # in order as one column per channel
+        chunks = [np.arange(n, dtype=np.float64) for n in [3, 700, 1, 450]]
+        handle, tempfilename = tempfile.mkstemp()
+        try:
+            writer = axographio.stream_writer(tempfilename,
+                    ['short', 'double', 'idle'],
+                    [np.int16, np.float64, np.float32], buffer_points=500)
+            for chunk in chunks:
+                writer.append(0, chunk)
+                writer.append(1, np.repeat(chunk / 4, 2))
+
+            # everything up to the last flush is readable before closing
+            partial = axographio.read(tempfilename)
+            self.assertEqual(len(partial.data), writer.columns)
+            writer.close()
+
+            streamed = axographio.read(tempfilename)
+        finally:
+            os.close(handle)
+            os.remove(tempfilename)
+
+        expected = np.concatenate(chunks)
+        self.assertEqual(streamed.names, ['short', 'double', 'idle'])
+        self.assertTrue(np.all(streamed.data[0] == expected))
+        self.assertTrue(np.all(
+            streamed.data[1] == np.repeat(expected / 4, 2)))
+        self.assertEqual(len(streamed.data[2]), 0)
+
+
 
 class TestRegressions(unittest.TestCase):
     """Tests for bugs that were found in previous releases"""
@@ -0,0 +1,81 @@
+"""Time reading many small Axograph files
+
+Copies the sample Axograph X file into a temporary directory the given number
+of times, adds one missing file, and times reading them all with read, one at
+a time, and with read_many, reading the files whole with pread and through
+io_uring. The files are read once first, so they are in the page cache.
+
+    python benchmarks/read_many.py [--files 4000] [--workers 1] [--repeat 5]
+
+"""
+
+import argparse
+import os
+import shutil
+import tempfile
+import time
+
+import pkg_resources
+
+import axographio
+
+
+def best_time(function, repeat):
+    """Run function repeat times and return the shortest time taken"""
+    times = []
+    for i in range(repeat):
+        start = time.time()
+        function()
+        times.append(time.time() - start)
+    return min(times)
+
+
+def read_each(paths):
+    for path in paths:
+        try:
+            axographio.read(path)
+        except IOError:
+            pass
+
+
+def read_all(paths, workers, use_ring):
+    # read_many raises the missing file's error once every file is read
+    try:
+        axographio.read_many(paths, workers=workers, use_ring=use_ring)
+    except IOError:
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--files', type=int, default=4000)
+    parser.add_argument('--workers', type=int, default=1)
+    parser.add_argument('--repeat', type=int, default=5)
+    options = parser.parse_args()
+
+    sample = pkg_resources.resource_filename('axographio',
+            'include/axograph_readwrite/AxoGraph X File.axgx')
+    directory = tempfile.mkdtemp()
+    try:
+        paths = []
+        for i in range(options.files):
+            path = os.path.join(directory, 'f%d.axgx' % i)
+            shutil.copyfile(sample, path)
+            paths.append(path)
+        paths.append(os.path.join(directory, 'missing.axgx'))
+
+        read_each(paths)
+        print('%d files, %d workers' % (options.files, options.workers))
+        print('read, one at a time  %7.1f ms' %
+                (1000 * best_time(lambda: read_each(paths), options.repeat)))
+        for use_ring, label in [(False, 'pread'), (True, 'io_uring')]:
+            elapsed = best_time(
+                    lambda: read_all(paths, options.workers, use_ring),
+                    options.repeat)
+            print('read_many, %-9s  %7.1f ms' % (label, 1000 * elapsed))
+    finally:
+        shutil.rmtree(directory)
+
+
+if __name__ == '__main__':
+    main()
@@ -94,11 +94,22 @@ setup(
             'axographio/include/axograph_readwrite/fileUtils.cpp',
             'axographio/include/axograph_readwrite/byteswap.cpp',
             'axographio/include/axograph_readwrite/stringUtils.cpp',
-            'axographio/include/axograph_readwrite/AxoGraph_ReadWrite.cpp'],
+            'axographio/include/axograph_readwrite/sampleUtils.cpp',
+            'axographio/include/axograph_readwrite/AxoGraph_ReadWrite.cpp',
+            'axographio/include/axograph_readwrite/AxoGraph_ReadMany.cpp',
+            'axographio/include/axograph_readwrite/AxoGraph_Stream.cpp',
+            'axographio/include/axograph_readwrite/AxoGraph_Trailer.cpp',
+            'axographio/include/axograph_readwrite/AxoGraph_Chunks.cpp'],
             language='c++', include_dirs=[numpy.get_include()],
-            define_macros=[('NO_CARBON',1)]
+            define_macros=[('NO_CARBON',1)],
+            # read_many uses std::thread
+            extra_compile_args=[] if sys.platform == 'win32' else ['-pthread'],
+            extra_link_args=[] if sys.platform == 'win32' else ['-pthread']
             )
         ],
+    entry_points = {'console_scripts': [
+        'axographio-index = axographio.corpus:main',
+        ]},
     test_suite = 'axographio.tests.test_axographio.test_suite',
     package_data = {'axographio.tests': [
         '../include/axograph_readwrite/AxoGraph Digitized File',